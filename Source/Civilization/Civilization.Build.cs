@@ -11,7 +11,7 @@ public class Civilization : ModuleRules
 		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "EnhancedInput" });
         
 		PrivateDependencyModuleNames.AddRange(new string[] { "UMG" , "ProceduralMeshComponent", "Slate", "SlateCore" }); //  UMG ģ
-        PrivateDependencyModuleNames.AddRange(new string[] {  });
+        PrivateDependencyModuleNames.AddRange(new string[] { "RenderCore", "RHI", "PhysicsCore" });
 
 		// Uncomment if you are using Slate UI
 		// PrivateDependencyModuleNames.AddRange(new string[] { "Slate", "SlateCore" });
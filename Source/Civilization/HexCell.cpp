@@ -1,6 +1,8 @@
 ﻿#include "HexCell.h"
 #include "HexMetrics.h"
 #include "HexDirection.h"
+#include "HexGrid.h"
+#include "HexCellStore.h"
 
 #define LOG_TO_FILE(Category, Verbosity, Format, ...) \
     UE_LOG(Category, Verbosity, Format, ##__VA_ARGS__); \
@@ -10,192 +12,164 @@ AHexCell::AHexCell()
 {
     PrimaryActorTick.bCanEverTick = false;
 
-    Neighbors.Init(nullptr, 6);
-
     SceneRoot = CreateDefaultSubobject<USceneComponent>(TEXT("SceneRoot"));
     RootComponent = SceneRoot;
 
-    Color = FLinearColor::White;
-    bHasOutgoingRoad = false;
-    bHasIncomingRoad = false;
+    Grid = nullptr;
+    CellIndex = INDEX_NONE;
     bIsHighlighted = false;
-    Elevation = 0;
 
     HighlightMeshComponent = nullptr;
     HighlightMaterial = nullptr; // 初始化为空，靠蓝图设置
 }
 
-void AHexCell::SetupCell(int32 X, int32 Z, const FVector& Position)
+void AHexCell::BindToCell(AHexGrid* InGrid, int32 InCellIndex)
 {
-    SetActorLocation(Position);
+    Grid = InGrid;
+    CellIndex = InCellIndex;
 
-    Coordinates = FHexCoordinates::FromOffsetCoordinates(X, Z);
-    Coordinates.Y = -Coordinates.X - Coordinates.Z;
-    UE_LOG(LogTemp, Log, TEXT("Cell at position (%d, %d) has coordinates (%d, %d, %d)"), X, Z, Coordinates.X, Coordinates.Y, Coordinates.Z);
+    const FHexCellStore& Store = Grid->GetCellStore();
+    Coordinates = Store.GetCoordinates(CellIndex);
+    SetActorLocation(Grid->GetActorTransform().TransformPosition(Store.GetPosition(CellIndex)));
+    SetActorHiddenInGame(false);
 }
 
-AHexCell* AHexCell::GetNeighbor(EHexDirection Direction) const
+void AHexCell::Unbind()
 {
-    return Neighbors[static_cast<int32>(Direction)];
+    SetHighlighted(false);
+    SetActorHiddenInGame(true);
+    Grid = nullptr;
+    CellIndex = INDEX_NONE;
 }
 
-void AHexCell::SetNeighbor(EHexDirection Direction, AHexCell* Cell)
+FLinearColor AHexCell::GetColor() const
 {
-    Neighbors[static_cast<int32>(Direction)] = Cell;
-    if (Cell)
-    {
-        Cell->Neighbors[static_cast<int32>(HexMetrics::Opposite(Direction))] = this;
-    }
+    return Grid ? Grid->GetCellStore().GetColor(CellIndex) : FLinearColor::White;
 }
 
-HexMetrics::EHexEdgeType AHexCell::GetEdgeType(EHexDirection Direction)
+void AHexCell::SetColor(FLinearColor NewColor)
 {
-    AHexCell* Neighbor = GetNeighbor(Direction);
-    if (!Neighbor)
+    if (Grid)
     {
-        return HexMetrics::EHexEdgeType::Cliff;
+        Grid->SetCellColor(CellIndex, Grid->GetCellStore().GetPalette().FindClosest(NewColor.ToFColor(true)));
     }
-    return HexMetrics::GetEdgeType(Elevation, Neighbor->Elevation);
 }
 
-HexMetrics::EHexEdgeType AHexCell::GetEdgeType(AHexCell* OtherCell)
+int32 AHexCell::GetColorIndex() const
 {
-    if (!OtherCell)
-    {
-        return HexMetrics::EHexEdgeType::Cliff;
-    }
-    return HexMetrics::GetEdgeType(Elevation, OtherCell->Elevation);
+    return Grid ? Grid->GetCellStore().GetColorIndex(CellIndex) : 0;
 }
 
-void AHexCell::SetElevation(int32 NewElevation)
+void AHexCell::SetColorIndex(int32 NewColorIndex)
 {
-    Elevation = NewElevation;
-    FVector Position = GetActorLocation();
-    Position.Z = NewElevation * HexMetrics::ElevationStep;
-    SetActorLocation(Position);
-
-    if (Chunk)
+    if (Grid)
     {
-        Chunk->Refresh();
+        Grid->SetCellColor(CellIndex, static_cast<uint8>(FMath::Clamp(NewColorIndex, 0, FHexCellPalette::MaxColors - 1)));
     }
 }
 
-void AHexCell::RemoveOutgoingRoad()
+int32 AHexCell::GetElevation() const
 {
-    if (!bHasOutgoingRoad)
-    {
-        return;
-    }
-
-    bHasOutgoingRoad = false;
-    RefreshSelfOnly();
-
-    AHexCell* Neighbor = GetNeighbor(OutgoingRoad);
-    if (Neighbor)
-    {
-        Neighbor->bHasIncomingRoad = false;
-        Neighbor->RefreshSelfOnly();
-    }
+    return Grid ? Grid->GetCellStore().GetElevation(CellIndex) : 0;
 }
 
-void AHexCell::RemoveIncomingRoad()
+void AHexCell::SetElevation(int32 NewElevation)
 {
-    if (!bHasIncomingRoad)
+    if (!Grid)
     {
         return;
     }
 
-    bHasIncomingRoad = false;
-    RefreshSelfOnly();
+    Grid->SetCellElevation(CellIndex, NewElevation);
+    SetActorLocation(Grid->GetActorTransform().TransformPosition(Grid->GetCellStore().GetPosition(CellIndex)));
+}
+
+int32 AHexCell::GetNeighborIndex(EHexDirection Direction) const
+{
+    return Grid ? Grid->GetCellStore().GetNeighbor(CellIndex, Direction) : INDEX_NONE;
+}
 
-    AHexCell* Neighbor = GetNeighbor(IncomingRoad);
-    if (Neighbor)
+HexMetrics::EHexEdgeType AHexCell::GetEdgeType(EHexDirection Direction) const
+{
+    if (!Grid)
     {
-        Neighbor->bHasOutgoingRoad = false;
-        Neighbor->RefreshSelfOnly();
+        return HexMetrics::EHexEdgeType::Cliff;
     }
+    return Grid->GetCellStore().GetEdgeType(CellIndex, Direction);
 }
 
-void AHexCell::RemoveRoad()
+FVector AHexCell::GetPosition() const
 {
-    RemoveOutgoingRoad();
-    RemoveIncomingRoad();
+    return Grid ? Grid->GetCellStore().GetPosition(CellIndex) : FVector::ZeroVector;
 }
 
-void AHexCell::SetOutgoingRoad(EHexDirection Direction)
+void AHexCell::RemoveOutgoingRoad()
 {
-    if (bHasOutgoingRoad && OutgoingRoad == Direction)
+    if (Grid)
     {
-        return;
+        Grid->RemoveOutgoingRoad(CellIndex);
     }
+}
 
-    AHexCell* Neighbor = GetNeighbor(Direction);
-    if (!Neighbor)
+void AHexCell::RemoveIncomingRoad()
+{
+    if (Grid)
     {
-        return;
+        Grid->RemoveIncomingRoad(CellIndex);
     }
+}
 
-    RemoveOutgoingRoad();
-    if (bHasIncomingRoad && IncomingRoad == Direction)
+void AHexCell::RemoveRoad()
+{
+    if (Grid)
     {
-        RemoveIncomingRoad();
+        Grid->RemoveRoad(CellIndex);
     }
-
-    bHasOutgoingRoad = true;
-    OutgoingRoad = Direction;
-    UE_LOG(LogTemp, Log, TEXT("SetOutgoingRoad: Cell (%d, %d) -> Dir %d"), Coordinates.X, Coordinates.Z, static_cast<int32>(Direction));
-    RefreshSelfOnly();
-
-    Neighbor->RemoveIncomingRoad();
-    Neighbor->bHasIncomingRoad = true;
-    Neighbor->IncomingRoad = HexMetrics::Opposite(Direction);
-    UE_LOG(LogTemp, Log, TEXT("SetIncomingRoad: Neighbor (%d, %d) <- Dir %d"), Neighbor->Coordinates.X, Neighbor->Coordinates.Z, static_cast<int32>(Neighbor->IncomingRoad));
-    Neighbor->RefreshSelfOnly();
 }
 
-void AHexCell::SetIncomingRoad(EHexDirection Direction)
+void AHexCell::SetOutgoingRoad(EHexDirection Direction)
 {
-    if (bHasIncomingRoad && IncomingRoad == Direction)
+    if (Grid)
     {
-        return;
+        UE_LOG(LogTemp, Log, TEXT("SetOutgoingRoad: Cell (%d, %d) -> Dir %d"), Coordinates.X, Coordinates.Z, static_cast<int32>(Direction));
+        Grid->SetOutgoingRoad(CellIndex, Direction);
     }
+}
 
-    AHexCell* Neighbor = GetNeighbor(Direction);
-    if (!Neighbor)
+void AHexCell::SetIncomingRoad(EHexDirection Direction)
+{
+    if (Grid)
     {
-        return;
+        UE_LOG(LogTemp, Log, TEXT("SetIncomingRoad: Cell (%d, %d) <- Dir %d"), Coordinates.X, Coordinates.Z, static_cast<int32>(Direction));
+        Grid->SetIncomingRoad(CellIndex, Direction);
     }
+}
 
-    RemoveIncomingRoad();
-    if (bHasOutgoingRoad && OutgoingRoad == Direction)
-    {
-        RemoveOutgoingRoad();
-    }
+bool AHexCell::HasIncomingRoad() const
+{
+    return Grid && Grid->GetCellStore().HasIncomingRoad(CellIndex);
+}
 
-    bHasIncomingRoad = true;
-    IncomingRoad = Direction;
-    UE_LOG(LogTemp, Log, TEXT("SetIncomingRoad: Cell (%d, %d) <- Dir %d"), Coordinates.X, Coordinates.Z, static_cast<int32>(Direction));
-    RefreshSelfOnly();
+bool AHexCell::HasOutgoingRoad() const
+{
+    return Grid && Grid->GetCellStore().HasOutgoingRoad(CellIndex);
 }
 
 bool AHexCell::HasRoad() const
 {
-    bool Result = bHasIncomingRoad || bHasOutgoingRoad;
-    return Result;
+    return Grid && Grid->GetCellStore().HasRoad(CellIndex);
 }
 
 bool AHexCell::HasRoadThroughEdge(EHexDirection Direction) const
 {
-    bool Result = (bHasIncomingRoad && IncomingRoad == Direction) ||
-        (bHasOutgoingRoad && OutgoingRoad == Direction);
-    return Result;
+    return Grid && Grid->GetCellStore().HasRoadThroughEdge(CellIndex, Direction);
 }
 
 void AHexCell::RefreshSelfOnly()
 {
-    if (Chunk)
+    if (Grid)
     {
-        Chunk->Refresh();
+        Grid->RefreshCell(CellIndex);
     }
 }
 
@@ -378,51 +352,19 @@ void AHexCell::SetHighlighted(bool bHighlight)
         TArray<FVector2D> UV0;
         TArray<FProcMeshTangent> Tangents;
 
-        // 通过 Coordinates 计算格子的局部坐标（相对于 AHexGrid）
-        int32 X = Coordinates.X + (Coordinates.Z - (Coordinates.Z & 1)) / 2; // 偏移坐标 X
-        int32 Z = Coordinates.Z; // 偏移坐标 Z
-        const float SpacingFactor = 1.0f;
-        float PosX = (X + Z * 0.5f - Z / 2) * (HexMetrics::InnerRadius * 2.0f) * SpacingFactor;
-        float PosY = Z * (HexMetrics::OuterRadius * 1.5f) * SpacingFactor;
-        FVector LocalPosition(PosX, PosY, 0.0f);
-
-        // 转换为世界坐标，调整为 (X, Y) -> (X, Y)
-        FVector WorldPosition = LocalPosition;
-        WorldPosition.X = LocalPosition.X;
-        WorldPosition.Y = LocalPosition.Y;
-
-        // 由于 HighlightMeshComponent 使用 KeepRelativeTransform，转换回 AHexCell 的局部坐标
-        FVector Center = GetActorTransform().InverseTransformPosition(WorldPosition);
+        // 描边顶点相对于 AHexCell（位于格子中心，含高度）
+        FVector Center = FVector::ZeroVector;
 
         float HighlightOffsetZ = 0.0f; // 调低高度
         float OutlineWidth = 0.2f; // 描边宽度
-        float OuterRadius = HexMetrics::OuterRadius; // 六边形外径
-
-        UE_LOG(LogTemp, Log, TEXT("Coordinates = (%d, %d, %d), LocalPosition = %s, WorldPosition = %s, Center (Relative) = %s"),
-            Coordinates.X, Coordinates.Y, Coordinates.Z,
-            *LocalPosition.ToString(),
-            *WorldPosition.ToString(),
-            *Center.ToString());
 
-        // 使用存储的扰动顶点
-        TArray<FVector> Corners = PerturbedCorners;
-        if (Corners.Num() != 6)
+        // 按需计算扰动后的顶点，与 AHexGridChunk 的三角化保持一致
+        const FVector CellPosition = GetPosition();
+        FVector Corners[6];
+        for (int32 i = 0; i < 6; i++)
         {
-            UE_LOG(LogTemp, Warning, TEXT("PerturbedCorners not initialized for cell (%d, %d), falling back to default corners"),
-                Coordinates.X, Coordinates.Z);
-            float InnerRadius = OuterRadius * FMath::Sqrt(3.0f) / 2.0f; // 六边形内径
-            Corners.SetNum(6);
-            Corners[0] = FVector(0.0f, OuterRadius, 0.0f);           // NE (尖顶)
-            Corners[1] = FVector(InnerRadius, OuterRadius / 2, 0.0f); // E
-            Corners[2] = FVector(InnerRadius, -OuterRadius / 2, 0.0f); // SE
-            Corners[3] = FVector(0.0f, -OuterRadius, 0.0f);          // SW
-            Corners[4] = FVector(-InnerRadius, -OuterRadius / 2, 0.0f); // W
-            Corners[5] = FVector(-InnerRadius, OuterRadius / 2, 0.0f);  // NW
-
-            for (int32 i = 0; i < 6; i++)
-            {
-                Corners[i] = Center + Corners[i];
-            }
+            const EHexDirection Direction = static_cast<EHexDirection>(i);
+            Corners[i] = HexMetrics::Perturb(CellPosition + HexMetrics::GetFirstSolidCorner(Direction)) - CellPosition;
         }
 
         // 构造空心描边
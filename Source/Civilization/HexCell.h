@@ -7,10 +7,15 @@
 #include "HexDirection.h" 
 #include "HexMetrics.h"
 #include "HexGridChunk.h" 
+#include "ProceduralMeshComponent.h"
 #include "HexCell.generated.h"
 
 enum class EHexDirection : uint8;
+class AHexGrid;
 
+// Optional actor proxy for a single cell. Cell data lives in the grid's
+// FHexCellStore; proxies are pooled by AHexGrid and only spawned for cells that
+// need an actor (highlighting, Blueprint access).
 UCLASS()
 class CIVILIZATION_API AHexCell : public AActor
 {
@@ -19,39 +24,41 @@ class CIVILIZATION_API AHexCell : public AActor
 public:
     AHexCell();
 
-    UPROPERTY()
-    AHexGridChunk* Chunk;
-
-    UPROPERTY()
-    TArray<FVector> PerturbedCorners; // 洢ε 6 㣨Ŷ
+    void BindToCell(AHexGrid* InGrid, int32 InCellIndex);
+    void Unbind();
 
-    void SetupCell(int32 X, int32 Z, const FVector& Position);
+    int32 GetCellIndex() const { return CellIndex; }
+    AHexGrid* GetGrid() const { return Grid; }
 
     UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Hex Cell")
     FHexCoordinates Coordinates;
 
-    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hex Cell")
-    FLinearColor Color;
+    UFUNCTION(BlueprintCallable, Category = "Hex Cell")
+    FLinearColor GetColor() const;
 
-    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Hex Cell")
-    int32 Elevation = 0;
+    // Paints the cell with the grid palette entry closest to NewColor.
+    UFUNCTION(BlueprintCallable, Category = "Hex Cell")
+    void SetColor(FLinearColor NewColor);
 
     UFUNCTION(BlueprintCallable, Category = "Hex Cell")
-    int32 GetElevation() const { return Elevation; }
+    int32 GetColorIndex() const;
 
     UFUNCTION(BlueprintCallable, Category = "Hex Cell")
-    void SetElevation(int32 NewElevation);
+    void SetColorIndex(int32 NewColorIndex);
+
+    UFUNCTION(BlueprintCallable, Category = "Hex Cell")
+    int32 GetElevation() const;
 
     UFUNCTION(BlueprintCallable, Category = "Hex Cell")
-    AHexCell* GetNeighbor(EHexDirection Direction) const;
+    void SetElevation(int32 NewElevation);
 
+    // Grid cell index of the neighbour, or INDEX_NONE. No proxy is acquired for it.
     UFUNCTION(BlueprintCallable, Category = "Hex Cell")
-    void SetNeighbor(EHexDirection Direction, AHexCell* Cell);
+    int32 GetNeighborIndex(EHexDirection Direction) const;
 
-    HexMetrics::EHexEdgeType GetEdgeType(EHexDirection Direction);
-    HexMetrics::EHexEdgeType GetEdgeType(AHexCell* OtherCell);
+    HexMetrics::EHexEdgeType GetEdgeType(EHexDirection Direction) const;
 
-    FVector GetPosition() const { return GetActorLocation(); }
+    FVector GetPosition() const;
 
     // Road
     UFUNCTION(BlueprintCallable, Category = "Road")
@@ -69,23 +76,17 @@ public:
     UFUNCTION(BlueprintCallable, Category = "Road")
     void SetIncomingRoad(EHexDirection Direction);
 
-    UPROPERTY(BlueprintReadOnly, Category = "Road")
-    bool bHasIncomingRoad = false;
-
-    UPROPERTY(BlueprintReadOnly, Category = "Road")
-    bool bHasOutgoingRoad = false;
-
-    UPROPERTY(BlueprintReadOnly, Category = "Road")
-    EHexDirection IncomingRoad = EHexDirection::NE;
+    UFUNCTION(BlueprintCallable, Category = "Road")
+    bool HasIncomingRoad() const;
 
-    UPROPERTY(BlueprintReadOnly, Category = "Road")
-    EHexDirection OutgoingRoad = EHexDirection::NE;
+    UFUNCTION(BlueprintCallable, Category = "Road")
+    bool HasOutgoingRoad() const;
 
     UFUNCTION(BlueprintCallable, Category = "Road")
     bool HasRoad() const;
 
     UFUNCTION(BlueprintCallable, Category = "Road")
-    bool HasRoadBeginOrEnd() const { return bHasIncomingRoad != bHasOutgoingRoad; }
+    bool HasRoadBeginOrEnd() const { return HasIncomingRoad() != HasOutgoingRoad(); }
 
     UFUNCTION(BlueprintCallable, Category = "Road")
     bool HasRoadThroughEdge(EHexDirection Direction) const;
@@ -103,7 +104,9 @@ public:
 private:
 
     UPROPERTY()
-    TArray<AHexCell*> Neighbors;
+    AHexGrid* Grid;
+
+    int32 CellIndex = INDEX_NONE;
 
     UPROPERTY()
     bool bIsHighlighted;
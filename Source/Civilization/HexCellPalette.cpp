@@ -0,0 +1,65 @@
+#include "HexCellPalette.h"
+#include "HexMetrics.h"
+#include <atomic>
+
+namespace
+{
+    std::atomic<uint32> NextPaletteId(1);
+}
+
+FHexCellPalette::FHexCellPalette(TArrayView<const FLinearColor> InColors, int32 InTerracesPerSlope)
+    : NumColors(FMath::Clamp(InColors.Num(), 1, MaxColors))
+    , TerracesPerSlope(FMath::Max(InTerracesPerSlope, 1))
+    , TerraceStride(TerracesPerSlope * 2 + 2)
+    , Id(NextPaletteId.fetch_add(1, std::memory_order_relaxed))
+{
+    for (int32 i = 0; i < UE_ARRAY_COUNT(LinearColors); i++)
+    {
+        LinearColors[i] = i < InColors.Num() && i < NumColors ? InColors[i] : FLinearColor::White;
+        VertexColors[i] = LinearColors[i].ToFColor(true);
+    }
+
+    const int32 Steps = TerraceStride - 1;
+    TerraceColors.SetNumUninitialized(NumColors * NumColors * TerraceStride);
+    FColor* Out = TerraceColors.GetData();
+    for (int32 A = 0; A < NumColors; A++)
+    {
+        for (int32 B = 0; B < NumColors; B++)
+        {
+            Out[0] = VertexColors[A];
+            for (int32 Step = 1; Step < Steps; Step++)
+            {
+                Out[Step] = FLinearColor::LerpUsingHSV(LinearColors[A], LinearColors[B], float(Step) / Steps).ToFColor(true);
+            }
+            Out[Steps] = VertexColors[B];
+            Out += TerraceStride;
+        }
+    }
+}
+
+const TSharedRef<const FHexCellPalette, ESPMode::ThreadSafe>& FHexCellPalette::GetDefault()
+{
+    static const TSharedRef<const FHexCellPalette, ESPMode::ThreadSafe> Default =
+        MakeShared<const FHexCellPalette, ESPMode::ThreadSafe>(TArrayView<const FLinearColor>(), HexMetrics::TerracesPerSlope);
+    return Default;
+}
+
+uint8 FHexCellPalette::FindClosest(const FColor& Color) const
+{
+    uint8 Best = 0;
+    int32 BestDistance = MAX_int32;
+    for (int32 i = 0; i < NumColors; i++)
+    {
+        const FColor& Entry = VertexColors[i];
+        const int32 DR = int32(Entry.R) - Color.R;
+        const int32 DG = int32(Entry.G) - Color.G;
+        const int32 DB = int32(Entry.B) - Color.B;
+        const int32 Distance = DR * DR + DG * DG + DB * DB;
+        if (Distance < BestDistance)
+        {
+            Best = static_cast<uint8>(i);
+            BestDistance = Distance;
+        }
+    }
+    return Best;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+// The colours cells can be painted with. Cells store an index into a palette,
+// and everything triangulation needs from a colour is worked out here once,
+// when the palette is built: the sRGB vertex colour of every entry and, for
+// every pair of entries, the vertex colour of each terrace step between them.
+//
+// A palette never changes after it is built and is shared with chunk builds in
+// flight, so new colours mean a new palette.
+class CIVILIZATION_API FHexCellPalette
+{
+public:
+    // Entries beyond this are dropped; the blend tables grow with its square.
+    static constexpr int32 MaxColors = 64;
+
+    // Blend tables are built for InTerracesPerSlope, the grid's terrace count.
+    // An empty InColors gives a single white entry.
+    FHexCellPalette(TArrayView<const FLinearColor> InColors, int32 InTerracesPerSlope);
+
+    // The single-white palette a cell store starts with.
+    static const TSharedRef<const FHexCellPalette, ESPMode::ThreadSafe>& GetDefault();
+
+    int32 Num() const { return NumColors; }
+    int32 GetTerracesPerSlope() const { return TerracesPerSlope; }
+
+    // Distinct for every palette built, for caches keyed on palette contents.
+    uint32 GetId() const { return Id; }
+
+    // Any uint8 is a valid index; indices past the palette read as white.
+    const FLinearColor& GetColor(uint8 Index) const { return LinearColors[Index]; }
+    FColor GetVertexColor(uint8 Index) const { return VertexColors[Index]; }
+
+    // sRGB colours of terrace steps 0 to TerracesPerSlope * 2 + 1 from entry A
+    // to entry B, blended in HSV like HexMetrics::TerraceLerp. Null if either
+    // index is outside the palette or Terraces is not the count it was built for.
+    const FColor* GetTerraceColors(uint8 A, uint8 B, int32 Terraces) const
+    {
+        if (Terraces != TerracesPerSlope || A >= NumColors || B >= NumColors)
+        {
+            return nullptr;
+        }
+        return &TerraceColors[(A * NumColors + B) * TerraceStride];
+    }
+
+    // Index of the entry closest to Color, for colours saved without a palette.
+    uint8 FindClosest(const FColor& Color) const;
+
+private:
+    int32 NumColors = 0;
+    int32 TerracesPerSlope = 0;
+    int32 TerraceStride = 0;
+    uint32 Id = 0;
+
+    FLinearColor LinearColors[256];
+    FColor VertexColors[256];
+    TArray<FColor> TerraceColors;
+};
@@ -0,0 +1,180 @@
+#include "HexCellStore.h"
+
+void FHexCellStore::Init(int32 InWidth, int32 InHeight)
+{
+    Width = FMath::Max(InWidth, 0);
+    Height = FMath::Max(InHeight, 0);
+    MapWidth = Width;
+
+    const int32 CellCount = Width * Height;
+    Elevations.Init(0, CellCount);
+    ColorIndices.Init(0, CellCount);
+    RoadBits.Init(0, CellCount);
+}
+
+void FHexCellStore::Reset()
+{
+    Width = 0;
+    Height = 0;
+    OriginX = 0;
+    OriginZ = 0;
+    MapWidth = 0;
+    Elevations.Empty();
+    ColorIndices.Empty();
+    RoadBits.Empty();
+}
+
+void FHexCellStore::CreateSnapshot(int32 MinX, int32 MinZ, int32 MaxX, int32 MaxZ, FHexCellStore& OutSnapshot) const
+{
+    MinX = FMath::Max(MinX, 0);
+    MinZ = FMath::Max(MinZ, 0);
+    MaxX = FMath::Min(MaxX, Width - 1);
+    MaxZ = FMath::Min(MaxZ, Height - 1);
+
+    OutSnapshot.Init(MaxX - MinX + 1, MaxZ - MinZ + 1);
+    OutSnapshot.OriginX = OriginX + MinX;
+    OutSnapshot.OriginZ = OriginZ + MinZ;
+    OutSnapshot.MapWidth = MapWidth;
+    OutSnapshot.Palette = Palette;
+
+    const int32 RowLength = OutSnapshot.Width;
+    for (int32 Z = MinZ; Z <= MaxZ; Z++)
+    {
+        const int32 Source = MinX + Z * Width;
+        const int32 Target = (Z - MinZ) * RowLength;
+        FMemory::Memcpy(&OutSnapshot.Elevations[Target], &Elevations[Source], RowLength * sizeof(int8));
+        FMemory::Memcpy(&OutSnapshot.ColorIndices[Target], &ColorIndices[Source], RowLength * sizeof(uint8));
+        FMemory::Memcpy(&OutSnapshot.RoadBits[Target], &RoadBits[Source], RowLength * sizeof(uint8));
+    }
+}
+
+FHexCoordinates FHexCellStore::GetCoordinates(int32 Index) const
+{
+    const int32 X = GetOffsetX(Index) + OriginX;
+    const int32 Z = GetOffsetZ(Index) + OriginZ;
+    return FHexCoordinates(X - Z / 2, Z);
+}
+
+int32 FHexCellStore::GetNeighbor(int32 Index, EHexDirection Direction) const
+{
+    const int32 X = GetOffsetX(Index);
+    const int32 Z = GetOffsetZ(Index);
+    // Odd map rows are shifted half a cell to the east.
+    const int32 Shift = (Z + OriginZ) & 1;
+
+    switch (Direction)
+    {
+    case EHexDirection::NE: return GetIndex(X + Shift, Z + 1);
+    case EHexDirection::E:  return GetIndex(X + 1, Z);
+    case EHexDirection::SE: return GetIndex(X + Shift, Z - 1);
+    case EHexDirection::SW: return GetIndex(X + Shift - 1, Z - 1);
+    case EHexDirection::W:  return GetIndex(X - 1, Z);
+    case EHexDirection::NW: return GetIndex(X + Shift - 1, Z + 1);
+    default:                return INDEX_NONE;
+    }
+}
+
+FVector FHexCellStore::GetOffsetPosition(int32 X, int32 Z)
+{
+    const float PosX = (X + Z * 0.5f - Z / 2) * (HexMetrics::InnerRadius * 2.0f);
+    const float PosY = Z * (HexMetrics::OuterRadius * 1.5f);
+    return FVector(PosX, PosY, 0.0f);
+}
+
+FVector FHexCellStore::GetPosition(int32 Index) const
+{
+    FVector Position = GetOffsetPosition(GetOffsetX(Index) + OriginX, GetOffsetZ(Index) + OriginZ);
+    Position.Z = Elevations[Index] * HexMetrics::ElevationStep;
+    return Position;
+}
+
+HexMetrics::EHexEdgeType FHexCellStore::GetEdgeType(int32 Index, EHexDirection Direction) const
+{
+    return GetEdgeType(Index, GetNeighbor(Index, Direction));
+}
+
+HexMetrics::EHexEdgeType FHexCellStore::GetEdgeType(int32 Index, int32 OtherIndex) const
+{
+    if (OtherIndex == INDEX_NONE)
+    {
+        return HexMetrics::EHexEdgeType::Cliff;
+    }
+    return HexMetrics::GetEdgeType(Elevations[Index], Elevations[OtherIndex]);
+}
+
+bool FHexCellStore::HasRoadThroughEdge(int32 Index, EHexDirection Direction) const
+{
+    return (HasIncomingRoad(Index) && GetIncomingRoad(Index) == Direction) ||
+        (HasOutgoingRoad(Index) && GetOutgoingRoad(Index) == Direction);
+}
+
+void FHexCellStore::SetOutgoingRoad(int32 Index, EHexDirection Direction, TArray<int32>& ChangedCells)
+{
+    if (HasOutgoingRoad(Index) && GetOutgoingRoad(Index) == Direction)
+    {
+        return;
+    }
+
+    const int32 Neighbor = GetNeighbor(Index, Direction);
+    if (Neighbor == INDEX_NONE)
+    {
+        return;
+    }
+
+    RemoveOutgoingRoad(Index, ChangedCells);
+    if (HasIncomingRoad(Index) && GetIncomingRoad(Index) == Direction)
+    {
+        RemoveIncomingRoad(Index, ChangedCells);
+    }
+
+    RoadBits[Index] = (RoadBits[Index] & ~OutgoingRoadMask) | HasOutgoingRoadBit |
+        static_cast<uint8>(static_cast<uint8>(Direction) << OutgoingRoadShift);
+    ChangedCells.AddUnique(Index);
+
+    RemoveIncomingRoad(Neighbor, ChangedCells);
+    RoadBits[Neighbor] = (RoadBits[Neighbor] & ~IncomingRoadMask) | HasIncomingRoadBit |
+        static_cast<uint8>(HexMetrics::Opposite(Direction));
+    ChangedCells.AddUnique(Neighbor);
+}
+
+void FHexCellStore::RemoveOutgoingRoad(int32 Index, TArray<int32>& ChangedCells)
+{
+    if (!HasOutgoingRoad(Index))
+    {
+        return;
+    }
+
+    RoadBits[Index] &= ~HasOutgoingRoadBit;
+    ChangedCells.AddUnique(Index);
+
+    const int32 Neighbor = GetNeighbor(Index, GetOutgoingRoad(Index));
+    if (Neighbor != INDEX_NONE)
+    {
+        RoadBits[Neighbor] &= ~HasIncomingRoadBit;
+        ChangedCells.AddUnique(Neighbor);
+    }
+}
+
+void FHexCellStore::RemoveIncomingRoad(int32 Index, TArray<int32>& ChangedCells)
+{
+    if (!HasIncomingRoad(Index))
+    {
+        return;
+    }
+
+    RoadBits[Index] &= ~HasIncomingRoadBit;
+    ChangedCells.AddUnique(Index);
+
+    const int32 Neighbor = GetNeighbor(Index, GetIncomingRoad(Index));
+    if (Neighbor != INDEX_NONE)
+    {
+        RoadBits[Neighbor] &= ~HasOutgoingRoadBit;
+        ChangedCells.AddUnique(Neighbor);
+    }
+}
+
+void FHexCellStore::RemoveRoad(int32 Index, TArray<int32>& ChangedCells)
+{
+    RemoveOutgoingRoad(Index, ChangedCells);
+    RemoveIncomingRoad(Index, ChangedCells);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HexCoordinates.h"
+#include "HexDirection.h"
+#include "HexMetrics.h"
+#include "HexCellPalette.h"
+
+// Structure-of-arrays storage for every cell of a grid. Cells are addressed by
+// their flat offset index (X + Z * Width); neighbours, coordinates and positions
+// are derived from that index instead of being stored per cell.
+//
+// A store can also be a snapshot of a sub-rectangle of the map. Offsets and
+// indices are then local to the snapshot, while coordinates, positions and
+// neighbour parity still follow the map through OriginX/OriginZ.
+struct CIVILIZATION_API FHexCellStore
+{
+public:
+    // Road bits: one incoming and one outgoing road per cell, each a direction plus a flag.
+    static constexpr uint8 IncomingRoadMask = 0x07;
+    static constexpr uint8 HasIncomingRoadBit = 0x08;
+    static constexpr int32 OutgoingRoadShift = 4;
+    static constexpr uint8 OutgoingRoadMask = 0x70;
+    static constexpr uint8 HasOutgoingRoadBit = 0x80;
+
+    void Init(int32 InWidth, int32 InHeight);
+    void Reset();
+
+    // Copies the cells in [MinX, MaxX] x [MinZ, MaxZ], clipped to this store.
+    void CreateSnapshot(int32 MinX, int32 MinZ, int32 MaxX, int32 MaxZ, FHexCellStore& OutSnapshot) const;
+
+    int32 GetWidth() const { return Width; }
+    int32 GetHeight() const { return Height; }
+    int32 GetOriginX() const { return OriginX; }
+    int32 GetOriginZ() const { return OriginZ; }
+    int32 GetMapWidth() const { return MapWidth; }
+    int32 Num() const { return Width * Height; }
+
+    bool IsValidIndex(int32 Index) const { return Index >= 0 && Index < Num(); }
+    bool IsValidOffset(int32 X, int32 Z) const { return X >= 0 && X < Width && Z >= 0 && Z < Height; }
+
+    int32 GetIndex(int32 X, int32 Z) const { return IsValidOffset(X, Z) ? X + Z * Width : INDEX_NONE; }
+    int32 GetIndex(const FHexCoordinates& Coordinates) const { return GetIndex(Coordinates.X + Coordinates.Z / 2 - OriginX, Coordinates.Z - OriginZ); }
+    int32 GetIndex(const FHexAxial& Cell) const { return GetIndex(Cell.GetOffsetX() - OriginX, Cell.GetOffsetZ() - OriginZ); }
+    FHexAxial GetAxial(int32 Index) const { return FHexAxial::FromOffset(GetOffsetX(Index) + OriginX, GetOffsetZ(Index) + OriginZ); }
+    int32 GetOffsetX(int32 Index) const { return Index % Width; }
+    int32 GetOffsetZ(int32 Index) const { return Index / Width; }
+    // Index of the cell in the full map, for snapshots.
+    int32 GetMapIndex(int32 Index) const { return GetOffsetX(Index) + OriginX + (GetOffsetZ(Index) + OriginZ) * MapWidth; }
+
+    FHexCoordinates GetCoordinates(int32 Index) const;
+    int32 GetNeighbor(int32 Index, EHexDirection Direction) const;
+
+    // Grid-local centre of the cell, including its elevation.
+    FVector GetPosition(int32 Index) const;
+    static FVector GetOffsetPosition(int32 X, int32 Z);
+
+    int32 GetElevation(int32 Index) const { return Elevations[Index]; }
+    void SetElevation(int32 Index, int32 Elevation) { Elevations[Index] = static_cast<int8>(FMath::Clamp<int32>(Elevation, MIN_int8, MAX_int8)); }
+
+    // Cells hold an index into the palette rather than a colour. The palette is
+    // shared with snapshots, so a snapshot reads the colours it was taken with.
+    uint8 GetColorIndex(int32 Index) const { return ColorIndices[Index]; }
+    void SetColorIndex(int32 Index, uint8 ColorIndex) { ColorIndices[Index] = ColorIndex; }
+    const FLinearColor& GetColor(int32 Index) const { return Palette->GetColor(ColorIndices[Index]); }
+    FColor GetVertexColor(int32 Index) const { return Palette->GetVertexColor(ColorIndices[Index]); }
+
+    const FHexCellPalette& GetPalette() const { return *Palette; }
+    void SetPalette(const TSharedRef<const FHexCellPalette, ESPMode::ThreadSafe>& InPalette) { Palette = InPalette; }
+
+    HexMetrics::EHexEdgeType GetEdgeType(int32 Index, EHexDirection Direction) const;
+    HexMetrics::EHexEdgeType GetEdgeType(int32 Index, int32 OtherIndex) const;
+
+    // Road
+    uint8 GetRoadBits(int32 Index) const { return RoadBits[Index]; }
+    void SetRoadBits(int32 Index, uint8 Bits) { RoadBits[Index] = Bits; }
+
+    bool HasIncomingRoad(int32 Index) const { return (RoadBits[Index] & HasIncomingRoadBit) != 0; }
+    bool HasOutgoingRoad(int32 Index) const { return (RoadBits[Index] & HasOutgoingRoadBit) != 0; }
+    EHexDirection GetIncomingRoad(int32 Index) const { return static_cast<EHexDirection>(RoadBits[Index] & IncomingRoadMask); }
+    EHexDirection GetOutgoingRoad(int32 Index) const { return static_cast<EHexDirection>((RoadBits[Index] & OutgoingRoadMask) >> OutgoingRoadShift); }
+    bool HasRoad(int32 Index) const { return (RoadBits[Index] & (HasIncomingRoadBit | HasOutgoingRoadBit)) != 0; }
+    bool HasRoadThroughEdge(int32 Index, EHexDirection Direction) const;
+
+    // Road edits keep both ends of a road consistent. Every cell whose road bits
+    // changed is appended to ChangedCells so the caller can refresh its chunk.
+    void SetOutgoingRoad(int32 Index, EHexDirection Direction, TArray<int32>& ChangedCells);
+    void RemoveOutgoingRoad(int32 Index, TArray<int32>& ChangedCells);
+    void RemoveIncomingRoad(int32 Index, TArray<int32>& ChangedCells);
+    void RemoveRoad(int32 Index, TArray<int32>& ChangedCells);
+
+private:
+    int32 Width = 0;
+    int32 Height = 0;
+    int32 OriginX = 0;
+    int32 OriginZ = 0;
+    int32 MapWidth = 0;
+
+    TArray<int8> Elevations;
+    TArray<uint8> ColorIndices;
+    TArray<uint8> RoadBits;
+
+    // Kept across Init and Reset.
+    TSharedRef<const FHexCellPalette, ESPMode::ThreadSafe> Palette = FHexCellPalette::GetDefault();
+};
@@ -0,0 +1,783 @@
+#include "HexChunkMeshComponent.h"
+#include "HexChunkTriangulator.h"
+#include "PrimitiveSceneProxy.h"
+#include "PrimitiveViewRelevance.h"
+#include "PrimitiveUniformShaderParameters.h"
+#include "SceneInterface.h"
+#include "SceneManagement.h"
+#include "LocalVertexFactory.h"
+#include "MaterialDomain.h"
+#include "Materials/Material.h"
+#include "Materials/MaterialRenderProxy.h"
+#include "Engine/Engine.h"
+#include "PhysicsEngine/BodySetup.h"
+#include "RenderingThread.h"
+#include "RHICommandList.h"
+
+namespace
+{
+    // Vertex range whose colours changed, and where its colours start in the
+    // update's colour array.
+    struct FHexColorSpan
+    {
+        int32 First;
+        int32 Count;
+    };
+
+    // Unchanged runs shorter than this are uploaded with their neighbours
+    // rather than splitting the update into another lock.
+    constexpr int32 ColorSpanMergeGap = 16;
+
+    // Largest mesh the shared constant streams cover, and the largest that
+    // still takes 16-bit indices.
+    constexpr int32 MaxSharedVertices = MAX_uint16 + 1;
+
+    // One persistent GPU vertex stream, with the view the local vertex factory
+    // reads it through under manual vertex fetch. It is reused while builds
+    // fit and only reallocated, at the size asked for, when one outgrows it.
+    //
+    // The buffer is static, never dynamic: a write-only lock of a dynamic
+    // buffer renames it and discards everything outside the locked range,
+    // while a locked range of a static buffer is staged and copied into the
+    // buffer on unlock, in order with the draws already submitted. That is
+    // what lets a colour pass upload a few ranges and keep the rest.
+    class FHexChunkVertexStream : public FVertexBuffer
+    {
+    public:
+        FHexChunkVertexStream(const TCHAR* InName, int32 InStride, EPixelFormat InFormat)
+            : Name(InName), Stride(InStride), Format(InFormat)
+        {
+        }
+
+        FShaderResourceViewRHIRef SRV;
+
+        // Returns true if the buffer was reallocated, so views onto it changed.
+        bool Reserve(FRHICommandListBase& RHICmdList, int32 NumVertices)
+        {
+            if (VertexBufferRHI && NumVertices <= Capacity)
+            {
+                return false;
+            }
+
+            Capacity = NumVertices;
+            FRHIResourceCreateInfo CreateInfo(Name);
+            VertexBufferRHI = RHICmdList.CreateVertexBuffer(Capacity * Stride, BUF_Static | BUF_ShaderResource, CreateInfo);
+            SRV = RHICmdList.CreateShaderResourceView(VertexBufferRHI, GPixelFormats[Format].BlockBytes, Format);
+            if (!IsInitialized())
+            {
+                InitResource(RHICmdList);
+            }
+            return true;
+        }
+
+        void* Lock(FRHICommandListBase& RHICmdList, int32 First, int32 Count)
+        {
+            return RHICmdList.LockBuffer(VertexBufferRHI, First * Stride, Count * Stride, RLM_WriteOnly);
+        }
+
+        void Unlock(FRHICommandListBase& RHICmdList)
+        {
+            RHICmdList.UnlockBuffer(VertexBufferRHI);
+        }
+
+        virtual void ReleaseRHI() override
+        {
+            SRV.SafeRelease();
+            FVertexBuffer::ReleaseRHI();
+            Capacity = 0;
+        }
+
+        SIZE_T GetAllocatedSize() const { return static_cast<SIZE_T>(Capacity) * Stride; }
+
+    private:
+        const TCHAR* Name;
+        int32 Stride;
+        EPixelFormat Format;
+        int32 Capacity = 0;
+    };
+
+    // Every chunk vertex faces up with the same tangent basis.
+    void WriteTangents(void* Out, int32 NumVertices)
+    {
+        const FPackedNormal TangentX(FVector3f(1.0f, 0.0f, 0.0f));
+        const FPackedNormal TangentZ(FVector4f(0.0f, 0.0f, 1.0f, 1.0f));
+        FPackedNormal* OutTangents = static_cast<FPackedNormal*>(Out);
+        for (int32 i = 0; i < NumVertices; i++)
+        {
+            OutTangents[2 * i] = TangentX;
+            OutTangents[2 * i + 1] = TangentZ;
+        }
+    }
+
+    // The tangent basis and the zero UV0 are the same for every chunk, so one
+    // copy of each is shared by all of them. They cannot be bound with a zero
+    // stride instead: under manual vertex fetch the local vertex factory reads
+    // tangents and texture coordinates by vertex id, with no index mask like
+    // the one it has for colours.
+    class FHexChunkConstantStreams : public FRenderResource
+    {
+    public:
+        FHexChunkConstantStreams()
+            : Tangents(TEXT("HexChunkSharedTangents"), 2 * sizeof(FPackedNormal), PF_R8G8B8A8_SNORM)
+            , TexCoords(TEXT("HexChunkSharedTexCoords"), sizeof(FVector2f), PF_G32R32F)
+        {
+        }
+
+        FHexChunkVertexStream Tangents;
+        FHexChunkVertexStream TexCoords;
+
+        virtual void InitRHI(FRHICommandListBase& RHICmdList) override
+        {
+            Tangents.Reserve(RHICmdList, MaxSharedVertices);
+            WriteTangents(Tangents.Lock(RHICmdList, 0, MaxSharedVertices), MaxSharedVertices);
+            Tangents.Unlock(RHICmdList);
+
+            TexCoords.Reserve(RHICmdList, MaxSharedVertices);
+            FMemory::Memzero(TexCoords.Lock(RHICmdList, 0, MaxSharedVertices), MaxSharedVertices * sizeof(FVector2f));
+            TexCoords.Unlock(RHICmdList);
+        }
+
+        virtual void ReleaseRHI() override
+        {
+            Tangents.ReleaseResource();
+            TexCoords.ReleaseResource();
+        }
+    };
+
+    TGlobalResource<FHexChunkConstantStreams> GHexChunkConstantStreams;
+
+    // Persistent index buffer holding 16-bit indices whenever the vertex count
+    // allows. Static for the same reason as FHexChunkVertexStream.
+    class FHexChunkIndexBuffer : public FIndexBuffer
+    {
+    public:
+        void Update(FRHICommandListBase& RHICmdList, const TArray<int32>& Indices, int32 NumVertices)
+        {
+            const int32 Stride = NumVertices <= MAX_uint16 + 1 ? sizeof(uint16) : sizeof(uint32);
+            if (!IndexBufferRHI || Indices.Num() > Capacity || Stride != IndexStride)
+            {
+                Capacity = Indices.Num();
+                IndexStride = Stride;
+                FRHIResourceCreateInfo CreateInfo(TEXT("HexChunkIndexBuffer"));
+                IndexBufferRHI = RHICmdList.CreateIndexBuffer(IndexStride, Capacity * IndexStride, BUF_Static, CreateInfo);
+                if (!IsInitialized())
+                {
+                    InitResource(RHICmdList);
+                }
+            }
+
+            void* Data = RHICmdList.LockBuffer(IndexBufferRHI, 0, Indices.Num() * IndexStride, RLM_WriteOnly);
+            if (IndexStride == sizeof(uint16))
+            {
+                uint16* Out = static_cast<uint16*>(Data);
+                for (int32 i = 0; i < Indices.Num(); i++)
+                {
+                    Out[i] = static_cast<uint16>(Indices[i]);
+                }
+            }
+            else
+            {
+                FMemory::Memcpy(Data, Indices.GetData(), Indices.Num() * sizeof(uint32));
+            }
+            RHICmdList.UnlockBuffer(IndexBufferRHI);
+        }
+
+        virtual void ReleaseRHI() override
+        {
+            FIndexBuffer::ReleaseRHI();
+            Capacity = 0;
+        }
+
+        SIZE_T GetAllocatedSize() const { return static_cast<SIZE_T>(Capacity) * IndexStride; }
+
+    private:
+        int32 Capacity = 0;
+        int32 IndexStride = sizeof(uint16);
+    };
+
+    // GPU copy of one chunk mesh. Per vertex: the packed int16 position, the
+    // shared tangent basis, one UV channel (three in cell data mode, which
+    // carries cell indices in UV1.xy and UV2.x) and the colour.
+    //
+    // Positions stay packed on the GPU and are read normalized, as value /
+    // 32767. PackedToLocal scales them by 32767 / PositionPrecision and moves
+    // them to the mesh origin, and is folded into the transform the section is
+    // drawn with.
+    class FHexChunkRenderSection
+    {
+    public:
+        FHexChunkRenderSection(ERHIFeatureLevel::Type FeatureLevel)
+            : Positions(TEXT("HexChunkPositions"), sizeof(FHexPackedPosition), PF_R16G16B16A16_SNORM)
+            , Colors(TEXT("HexChunkColors"), sizeof(FColor), PF_R8G8B8A8)
+            , VertexFactory(FeatureLevel, "FHexChunkRenderSection")
+            , Tangents(TEXT("HexChunkTangents"), 2 * sizeof(FPackedNormal), PF_R8G8B8A8_SNORM)
+            , TexCoords(TEXT("HexChunkTexCoords"), sizeof(FVector2f), PF_G32R32F)
+        {
+        }
+
+        FHexChunkVertexStream Positions;
+        FHexChunkVertexStream Colors;
+        FHexChunkIndexBuffer Indices;
+        FLocalVertexFactory VertexFactory;
+        int32 NumVertices = 0;
+        int32 NumIndices = 0;
+        FMatrix PackedToLocal = FMatrix::Identity;
+
+        void Update(FRHICommandListBase& RHICmdList, const FHexChunkMeshData& Mesh)
+        {
+            NumVertices = Mesh.NumVertices();
+            NumIndices = Mesh.Triangles.Num();
+            PackedToLocal = FScaleMatrix(FVector(MAX_int16 / FHexChunkMeshData::PositionPrecision)) * FTranslationMatrix(Mesh.Origin);
+            if (NumVertices == 0 || NumIndices == 0)
+            {
+                NumIndices = 0;
+                return;
+            }
+
+            const bool bCellData = Mesh.CellIndices.Num() == NumVertices;
+            const bool bSharedTangents = NumVertices <= MaxSharedVertices;
+            const bool bSharedTexCoords = bSharedTangents && !bCellData;
+            const int32 NewNumTexCoords = bCellData ? 3 : 1;
+            bool bRebind = !VertexFactory.IsInitialized() || NewNumTexCoords != NumTexCoords ||
+                bSharedTangents != bUsesSharedTangents || bSharedTexCoords != bUsesSharedTexCoords;
+            NumTexCoords = NewNumTexCoords;
+            bUsesSharedTangents = bSharedTangents;
+            bUsesSharedTexCoords = bSharedTexCoords;
+
+            bRebind |= Positions.Reserve(RHICmdList, NumVertices);
+            FMemory::Memcpy(Positions.Lock(RHICmdList, 0, NumVertices), Mesh.Positions.GetData(), NumVertices * sizeof(FHexPackedPosition));
+            Positions.Unlock(RHICmdList);
+
+            bRebind |= Colors.Reserve(RHICmdList, NumVertices);
+            FMemory::Memcpy(Colors.Lock(RHICmdList, 0, NumVertices), Mesh.VertexColors.GetData(), NumVertices * sizeof(FColor));
+            Colors.Unlock(RHICmdList);
+
+            // Meshes too big for the shared streams keep their own copies.
+            if (bSharedTangents)
+            {
+                Tangents.ReleaseResource();
+            }
+            else
+            {
+                bRebind |= Tangents.Reserve(RHICmdList, NumVertices);
+                WriteTangents(Tangents.Lock(RHICmdList, 0, NumVertices), NumVertices);
+                Tangents.Unlock(RHICmdList);
+            }
+
+            if (bSharedTexCoords)
+            {
+                TexCoords.ReleaseResource();
+            }
+            else
+            {
+                bRebind |= TexCoords.Reserve(RHICmdList, NumVertices * NumTexCoords);
+                FVector2f* OutTexCoords = static_cast<FVector2f*>(TexCoords.Lock(RHICmdList, 0, NumVertices * NumTexCoords));
+                for (int32 i = 0; i < NumVertices; i++)
+                {
+                    OutTexCoords[i * NumTexCoords] = FVector2f::ZeroVector;
+                    if (bCellData)
+                    {
+                        const FVector3f& Cells = Mesh.CellIndices[i];
+                        OutTexCoords[i * NumTexCoords + 1] = FVector2f(Cells.X, Cells.Y);
+                        OutTexCoords[i * NumTexCoords + 2] = FVector2f(Cells.Z, 0.0f);
+                    }
+                }
+                TexCoords.Unlock(RHICmdList);
+            }
+
+            Indices.Update(RHICmdList, Mesh.Triangles, NumVertices);
+
+            if (bRebind)
+            {
+                BindVertexFactory(RHICmdList);
+            }
+        }
+
+        void UpdateColors(FRHICommandListBase& RHICmdList, const TArray<FHexColorSpan>& Spans, const TArray<FColor>& NewColors)
+        {
+            int32 Source = 0;
+            for (const FHexColorSpan& Span : Spans)
+            {
+                if (Span.First + Span.Count <= NumVertices)
+                {
+                    FMemory::Memcpy(Colors.Lock(RHICmdList, Span.First, Span.Count), &NewColors[Source], Span.Count * sizeof(FColor));
+                    Colors.Unlock(RHICmdList);
+                }
+                Source += Span.Count;
+            }
+        }
+
+        void Release()
+        {
+            VertexFactory.ReleaseResource();
+            Positions.ReleaseResource();
+            Tangents.ReleaseResource();
+            TexCoords.ReleaseResource();
+            Colors.ReleaseResource();
+            Indices.ReleaseResource();
+        }
+
+        SIZE_T GetAllocatedSize() const
+        {
+            return Positions.GetAllocatedSize() + Tangents.GetAllocatedSize() + TexCoords.GetAllocatedSize() +
+                Colors.GetAllocatedSize() + Indices.GetAllocatedSize();
+        }
+
+    private:
+        // Used only when the shared streams do not fit the mesh.
+        FHexChunkVertexStream Tangents;
+        FHexChunkVertexStream TexCoords;
+        int32 NumTexCoords = 0;
+        bool bUsesSharedTangents = false;
+        bool bUsesSharedTexCoords = false;
+
+        void BindVertexFactory(FRHICommandListBase& RHICmdList)
+        {
+            const FHexChunkVertexStream& TangentStream = bUsesSharedTangents ? GHexChunkConstantStreams.Tangents : Tangents;
+            const FHexChunkVertexStream& TexCoordStream = bUsesSharedTexCoords ? GHexChunkConstantStreams.TexCoords : TexCoords;
+
+            FLocalVertexFactory::FDataType Data;
+            Data.PositionComponent = FVertexStreamComponent(&Positions, 0, sizeof(FHexPackedPosition), VET_Short4N);
+            Data.PositionComponentSRV = Positions.SRV;
+            Data.TangentBasisComponents[0] = FVertexStreamComponent(&TangentStream, 0, 2 * sizeof(FPackedNormal), VET_PackedNormal);
+            Data.TangentBasisComponents[1] = FVertexStreamComponent(&TangentStream, sizeof(FPackedNormal), 2 * sizeof(FPackedNormal), VET_PackedNormal);
+            Data.TangentsSRV = TangentStream.SRV;
+            for (int32 i = 0; i < NumTexCoords; i++)
+            {
+                Data.TextureCoordinates.Add(FVertexStreamComponent(
+                    &TexCoordStream, i * sizeof(FVector2f), NumTexCoords * sizeof(FVector2f), VET_Float2, EVertexStreamUsage::ManualFetch));
+            }
+            Data.TextureCoordinatesSRV = TexCoordStream.SRV;
+            Data.NumTexCoords = NumTexCoords;
+            Data.LightMapCoordinateIndex = 0;
+            Data.ColorComponent = FVertexStreamComponent(&Colors, 0, sizeof(FColor), VET_Color, EVertexStreamUsage::ManualFetch);
+            Data.ColorComponentsSRV = Colors.SRV;
+            Data.ColorIndexMask = ~0u;
+
+            VertexFactory.SetData(RHICmdList, Data);
+            if (!VertexFactory.IsInitialized())
+            {
+                VertexFactory.InitResource(RHICmdList);
+            }
+        }
+    };
+
+    class FHexChunkMeshSceneProxy final : public FPrimitiveSceneProxy
+    {
+    public:
+        FHexChunkMeshSceneProxy(UHexChunkMeshComponent* Component, TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe> InMesh)
+            : FPrimitiveSceneProxy(Component)
+            , InitialMesh(MoveTemp(InMesh))
+            , MaterialRelevance(Component->GetMaterialRelevance(GetScene().GetFeatureLevel()))
+        {
+            Material = Component->GetMaterial(0);
+            if (!Material)
+            {
+                Material = UMaterial::GetDefaultMaterial(MD_Surface);
+            }
+
+            for (TUniquePtr<FHexChunkRenderSection>& Section : Sections)
+            {
+                Section = MakeUnique<FHexChunkRenderSection>(GetScene().GetFeatureLevel());
+            }
+        }
+
+        virtual ~FHexChunkMeshSceneProxy()
+        {
+            for (TUniquePtr<FHexChunkRenderSection>& Section : Sections)
+            {
+                Section->Release();
+            }
+        }
+
+        virtual SIZE_T GetTypeHash() const override
+        {
+            static size_t UniquePointer;
+            return reinterpret_cast<size_t>(&UniquePointer);
+        }
+
+        virtual void CreateRenderThreadResources(FRHICommandListBase& RHICmdList) override
+        {
+            if (InitialMesh)
+            {
+                Sections[Front]->Update(RHICmdList, *InitialMesh);
+                InitialMesh.Reset();
+            }
+        }
+
+        // A new build goes into the section not being drawn, which then
+        // becomes the drawn one.
+        void SetMesh_RenderThread(FRHICommandListBase& RHICmdList, const FHexChunkMeshData& Mesh)
+        {
+            const int32 Back = 1 - Front;
+            Sections[Back]->Update(RHICmdList, Mesh);
+            Front = Back;
+        }
+
+        void UpdateColors_RenderThread(FRHICommandListBase& RHICmdList, const TArray<FHexColorSpan>& Spans, const TArray<FColor>& Colors)
+        {
+            Sections[Front]->UpdateColors(RHICmdList, Spans, Colors);
+        }
+
+        virtual void GetDynamicMeshElements(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily, uint32 VisibilityMap,
+            FMeshElementCollector& Collector) const override
+        {
+            const FHexChunkRenderSection& Section = *Sections[Front];
+            if (Section.NumIndices == 0)
+            {
+                return;
+            }
+
+            FMaterialRenderProxy* MaterialProxy = Material->GetRenderProxy();
+            if (AllowDebugViewmodes() && ViewFamily.EngineShowFlags.Wireframe)
+            {
+                FColoredMaterialRenderProxy* WireframeMaterial = new FColoredMaterialRenderProxy(
+                    GEngine->WireframeMaterial ? GEngine->WireframeMaterial->GetRenderProxy() : nullptr, FLinearColor(0.0f, 0.5f, 1.0f));
+                Collector.RegisterOneFrameMaterialProxy(WireframeMaterial);
+                MaterialProxy = WireframeMaterial;
+            }
+
+            for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+            {
+                if (!(VisibilityMap & (1 << ViewIndex)))
+                {
+                    continue;
+                }
+
+                FMeshBatch& Mesh = Collector.AllocateMesh();
+                Mesh.bWireframe = ViewFamily.EngineShowFlags.Wireframe;
+                Mesh.VertexFactory = &Section.VertexFactory;
+                Mesh.MaterialRenderProxy = MaterialProxy;
+                Mesh.ReverseCulling = IsLocalToWorldDeterminantNegative();
+                Mesh.Type = PT_TriangleList;
+                Mesh.DepthPriorityGroup = SDPG_World;
+                Mesh.bCanApplyViewModeOverrides = false;
+
+                bool bHasPrecomputedVolumetricLightmap;
+                FMatrix PreviousLocalToWorld;
+                int32 SingleCaptureIndex;
+                bool bOutputVelocity;
+                GetScene().GetPrimitiveUniformShaderParameters_RenderThread(
+                    GetPrimitiveSceneInfo(), bHasPrecomputedVolumetricLightmap, PreviousLocalToWorld, SingleCaptureIndex, bOutputVelocity);
+                bOutputVelocity |= AlwaysHasVelocity();
+
+                // The vertex factory reads packed positions, so the section is
+                // drawn in packed space: local bounds and both transforms start
+                // from PackedToLocal.
+                const FBoxSphereBounds PackedBounds = GetLocalBounds().TransformBy(Section.PackedToLocal.Inverse());
+                FDynamicPrimitiveUniformBuffer& UniformBuffer = Collector.AllocateOneFrameResource<FDynamicPrimitiveUniformBuffer>();
+                UniformBuffer.Set(Collector.GetRHICommandList(), Section.PackedToLocal * GetLocalToWorld(), Section.PackedToLocal * PreviousLocalToWorld,
+                    GetBounds(), PackedBounds, PackedBounds, true, bHasPrecomputedVolumetricLightmap, bOutputVelocity, GetCustomPrimitiveData());
+
+                FMeshBatchElement& Element = Mesh.Elements[0];
+                Element.IndexBuffer = &Section.Indices;
+                Element.PrimitiveUniformBufferResource = &UniformBuffer.UniformBuffer;
+                Element.FirstIndex = 0;
+                Element.NumPrimitives = Section.NumIndices / 3;
+                Element.MinVertexIndex = 0;
+                Element.MaxVertexIndex = Section.NumVertices - 1;
+
+                Collector.AddMesh(ViewIndex, Mesh);
+            }
+        }
+
+        virtual FPrimitiveViewRelevance GetViewRelevance(const FSceneView* View) const override
+        {
+            FPrimitiveViewRelevance Result;
+            Result.bDrawRelevance = IsShown(View);
+            Result.bShadowRelevance = IsShadowCast(View);
+            Result.bDynamicRelevance = true;
+            Result.bRenderInMainPass = ShouldRenderInMainPass();
+            Result.bUsesLightingChannels = GetLightingChannelMask() != GetDefaultLightingChannelMask();
+            Result.bRenderCustomDepth = ShouldRenderCustomDepth();
+            MaterialRelevance.SetPrimitiveViewRelevance(Result);
+            Result.bVelocityRelevance = DrawsVelocity() && Result.bOpaque && Result.bRenderInMainPass;
+            return Result;
+        }
+
+        virtual bool CanBeOccluded() const override { return !MaterialRelevance.bDisableDepthTest; }
+        virtual uint32 GetMemoryFootprint() const override { return sizeof(*this) + GetAllocatedSize(); }
+
+        SIZE_T GetAllocatedSize() const
+        {
+            return FPrimitiveSceneProxy::GetAllocatedSize() + Sections[0]->GetAllocatedSize() + Sections[1]->GetAllocatedSize();
+        }
+
+    private:
+        TUniquePtr<FHexChunkRenderSection> Sections[2];
+        int32 Front = 0;
+        TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe> InitialMesh;
+        UMaterialInterface* Material;
+        FMaterialRelevance MaterialRelevance;
+    };
+}
+
+UHexChunkMeshComponent::UHexChunkMeshComponent(const FObjectInitializer& ObjectInitializer)
+    : Super(ObjectInitializer)
+{
+}
+
+void UHexChunkMeshComponent::SetMesh(TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe> InMesh, bool bInComplexCollision)
+{
+    Mesh = MoveTemp(InMesh);
+    UpdateLocalBounds();
+
+    if (SceneProxy && Mesh)
+    {
+        FHexChunkMeshSceneProxy* Proxy = static_cast<FHexChunkMeshSceneProxy*>(SceneProxy);
+        ENQUEUE_RENDER_COMMAND(HexChunkSetMesh)(
+            [Proxy, RenderMesh = Mesh](FRHICommandListImmediate& RHICmdList)
+            {
+                Proxy->SetMesh_RenderThread(RHICmdList, *RenderMesh);
+            });
+        UpdateBounds();
+        MarkRenderTransformDirty();
+    }
+    else
+    {
+        MarkRenderStateDirty();
+    }
+
+    bComplexCollision = bInComplexCollision;
+    if (bHasCollision || bComplexCollision || (Mesh && Mesh->CollisionPrisms.Num() > 0))
+    {
+        UpdateCollision();
+    }
+}
+
+void UHexChunkMeshComponent::ClearMesh()
+{
+    if (!Mesh)
+    {
+        return;
+    }
+
+    Mesh.Reset();
+    UpdateLocalBounds();
+    MarkRenderStateDirty();
+
+    bComplexCollision = false;
+    if (bHasCollision)
+    {
+        UpdateCollision();
+    }
+}
+
+bool UHexChunkMeshComponent::UpdateColors(const TArray<FColor>& Colors)
+{
+    if (!Mesh || Colors.Num() != Mesh->VertexColors.Num())
+    {
+        return false;
+    }
+
+    // The render thread may still hold the mesh for an upload it has not run
+    // yet, so a shared mesh is copied before it is changed.
+    if (!Mesh.IsUnique())
+    {
+        Mesh = MakeShared<FHexChunkMeshData, ESPMode::ThreadSafe>(*Mesh);
+    }
+
+    TArray<FHexColorSpan> Spans;
+    TArray<FColor> Changed;
+    TArray<FColor>& Current = Mesh->VertexColors;
+    for (int32 i = 0; i < Colors.Num(); i++)
+    {
+        if (Colors[i] == Current[i])
+        {
+            continue;
+        }
+
+        FHexColorSpan* Last = Spans.Num() > 0 ? &Spans.Last() : nullptr;
+        if (Last && i - (Last->First + Last->Count) <= ColorSpanMergeGap)
+        {
+            Changed.Append(&Colors[Last->First + Last->Count], i + 1 - (Last->First + Last->Count));
+            Last->Count = i + 1 - Last->First;
+        }
+        else
+        {
+            Spans.Add({ i, 1 });
+            Changed.Add(Colors[i]);
+        }
+    }
+
+    if (Spans.Num() == 0)
+    {
+        return true;
+    }
+    Current = Colors;
+
+    if (SceneProxy)
+    {
+        FHexChunkMeshSceneProxy* Proxy = static_cast<FHexChunkMeshSceneProxy*>(SceneProxy);
+        ENQUEUE_RENDER_COMMAND(HexChunkUpdateColors)(
+            [Proxy, Spans = MoveTemp(Spans), Changed = MoveTemp(Changed)](FRHICommandListImmediate& RHICmdList)
+            {
+                Proxy->UpdateColors_RenderThread(RHICmdList, Spans, Changed);
+            });
+    }
+    return true;
+}
+
+int32 UHexChunkMeshComponent::GetNumVertices() const
+{
+    return Mesh ? Mesh->NumVertices() : 0;
+}
+
+FPrimitiveSceneProxy* UHexChunkMeshComponent::CreateSceneProxy()
+{
+    if (!Mesh || Mesh->NumVertices() == 0)
+    {
+        return nullptr;
+    }
+    return new FHexChunkMeshSceneProxy(this, Mesh);
+}
+
+FBoxSphereBounds UHexChunkMeshComponent::CalcBounds(const FTransform& LocalToWorld) const
+{
+    if (!LocalBounds.IsValid)
+    {
+        return FBoxSphereBounds(LocalToWorld.GetLocation(), FVector::ZeroVector, 0.0f);
+    }
+    return FBoxSphereBounds(LocalBounds).TransformBy(LocalToWorld);
+}
+
+void UHexChunkMeshComponent::UpdateLocalBounds()
+{
+    LocalBounds.Init();
+    if (!Mesh || Mesh->NumVertices() == 0)
+    {
+        return;
+    }
+
+    FHexPackedPosition Min = Mesh->Positions[0];
+    FHexPackedPosition Max = Mesh->Positions[0];
+    for (const FHexPackedPosition& Position : Mesh->Positions)
+    {
+        Min.X = FMath::Min(Min.X, Position.X);
+        Min.Y = FMath::Min(Min.Y, Position.Y);
+        Min.Z = FMath::Min(Min.Z, Position.Z);
+        Max.X = FMath::Max(Max.X, Position.X);
+        Max.Y = FMath::Max(Max.Y, Position.Y);
+        Max.Z = FMath::Max(Max.Z, Position.Z);
+    }
+    LocalBounds = FBox(
+        Mesh->Origin + FVector(Min.X, Min.Y, Min.Z) / FHexChunkMeshData::PositionPrecision,
+        Mesh->Origin + FVector(Max.X, Max.Y, Max.Z) / FHexChunkMeshData::PositionPrecision);
+}
+
+bool UHexChunkMeshComponent::GetPhysicsTriMeshData(FTriMeshCollisionData* CollisionData, bool InUseAllTriData)
+{
+    if (!ContainsPhysicsTriMeshData(InUseAllTriData))
+    {
+        return false;
+    }
+
+    const int32 NumVertices = Mesh->NumVertices();
+    CollisionData->Vertices.SetNumUninitialized(NumVertices);
+    for (int32 i = 0; i < NumVertices; i++)
+    {
+        CollisionData->Vertices[i] = FVector3f(Mesh->GetPosition(i));
+    }
+
+    const int32 NumTriangles = Mesh->Triangles.Num() / 3;
+    CollisionData->Indices.SetNumUninitialized(NumTriangles);
+    CollisionData->MaterialIndices.Init(0, NumTriangles);
+    for (int32 i = 0; i < NumTriangles; i++)
+    {
+        CollisionData->Indices[i].v0 = Mesh->Triangles[3 * i];
+        CollisionData->Indices[i].v1 = Mesh->Triangles[3 * i + 1];
+        CollisionData->Indices[i].v2 = Mesh->Triangles[3 * i + 2];
+    }
+
+    CollisionData->bFlipNormals = true;
+    CollisionData->bDeformableMesh = true;
+    CollisionData->bFastCook = true;
+    return true;
+}
+
+bool UHexChunkMeshComponent::ContainsPhysicsTriMeshData(bool InUseAllTriData) const
+{
+    return bComplexCollision && Mesh && Mesh->Triangles.Num() >= 3;
+}
+
+UBodySetup* UHexChunkMeshComponent::GetBodySetup()
+{
+    if (!BodySetup)
+    {
+        BodySetup = CreateBodySetup();
+    }
+    return BodySetup;
+}
+
+UBodySetup* UHexChunkMeshComponent::CreateBodySetup()
+{
+    UBodySetup* NewBodySetup = NewObject<UBodySetup>(this, NAME_None, IsTemplate() ? RF_Public | RF_ArchetypeObject : RF_NoFlags);
+    NewBodySetup->BodySetupGuid = FGuid::NewGuid();
+    NewBodySetup->bGenerateMirroredCollision = false;
+    NewBodySetup->bDoubleSidedGeometry = true;
+    return NewBodySetup;
+}
+
+void UHexChunkMeshComponent::UpdateCollision()
+{
+    const UWorld* World = GetWorld();
+    const bool bAsync = World && World->IsGameWorld() && bUseAsyncCooking;
+
+    UBodySetup* UseBodySetup;
+    if (bAsync)
+    {
+        UseBodySetup = AsyncBodySetupQueue.Add_GetRef(CreateBodySetup());
+    }
+    else
+    {
+        AsyncBodySetupQueue.Empty();
+        UseBodySetup = GetBodySetup();
+    }
+
+    UseBodySetup->CollisionTraceFlag = bUseComplexAsSimpleCollision ? CTF_UseComplexAsSimple : CTF_UseDefault;
+    UseBodySetup->AggGeom.ConvexElems.Reset();
+    if (Mesh)
+    {
+        for (const TArray<FVector>& Prism : Mesh->CollisionPrisms)
+        {
+            FKConvexElem& Element = UseBodySetup->AggGeom.ConvexElems.AddDefaulted_GetRef();
+            Element.VertexData = Prism;
+            Element.UpdateElemBox();
+        }
+    }
+    bHasCollision = bComplexCollision || UseBodySetup->AggGeom.ConvexElems.Num() > 0;
+
+    if (bAsync)
+    {
+        UseBodySetup->CreatePhysicsMeshesAsync(FOnAsyncPhysicsCookFinished::CreateUObject(this, &UHexChunkMeshComponent::FinishPhysicsAsyncCook, UseBodySetup));
+    }
+    else
+    {
+        UseBodySetup->BodySetupGuid = FGuid::NewGuid();
+        UseBodySetup->bHasCookedCollisionData = true;
+        UseBodySetup->InvalidatePhysicsData();
+        UseBodySetup->CreatePhysicsMeshes();
+        RecreatePhysicsState();
+    }
+}
+
+void UHexChunkMeshComponent::FinishPhysicsAsyncCook(bool bSuccess, UBodySetup* FinishedBodySetup)
+{
+    const int32 FoundIndex = AsyncBodySetupQueue.Find(FinishedBodySetup);
+    if (FoundIndex == INDEX_NONE)
+    {
+        return;
+    }
+
+    // Older cooks still running are superseded by this one.
+    if (bSuccess)
+    {
+        BodySetup = FinishedBodySetup;
+        RecreatePhysicsState();
+        AsyncBodySetupQueue.RemoveAt(0, FoundIndex + 1);
+    }
+    else
+    {
+        AsyncBodySetupQueue.RemoveAt(FoundIndex);
+    }
+}
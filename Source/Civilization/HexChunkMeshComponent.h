@@ -0,0 +1,87 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/MeshComponent.h"
+#include "Interfaces/Interface_CollisionDataProvider.h"
+#include "HexChunkMeshComponent.generated.h"
+
+struct FHexChunkMeshData;
+class UBodySetup;
+
+// Renders one chunk mesh straight from FHexChunkMeshData, in place of a
+// procedural mesh section. The scene proxy keeps two sets of persistent GPU
+// buffers: a new build is written to the set not being drawn and swapped in,
+// and buffers are only reallocated when a build outgrows them. Colour passes
+// upload just the vertex ranges whose colour changed, so painting a cell sends
+// a few kilobytes instead of the whole chunk. The constant tangent basis and
+// UV0 come from streams shared by every chunk.
+//
+// The component keeps the compact mesh it was given (it is needed to recreate
+// the proxy and to cook collision), but no expanded copy of it. Positions are
+// uploaded still packed, as normalized int16 x4 (R16G16B16A16_SNORM), 8 bytes
+// a vertex; the proxy scales them back into place with the draw transform.
+UCLASS(ClassGroup = Rendering)
+class CIVILIZATION_API UHexChunkMeshComponent : public UMeshComponent, public IInterface_CollisionDataProvider
+{
+    GENERATED_BODY()
+
+public:
+    UHexChunkMeshComponent(const FObjectInitializer& ObjectInitializer);
+
+    // Replaces the mesh. The component holds on to InMesh, which must not be
+    // modified afterwards except through UpdateColors. Collision is the mesh
+    // itself when bInComplexCollision is set, plus one convex element per
+    // entry of InMesh->CollisionPrisms.
+    void SetMesh(TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe> InMesh, bool bInComplexCollision);
+    void ClearMesh();
+
+    // Replaces the vertex colours of the current mesh. Returns false, changing
+    // nothing, if the count does not match the current vertex count.
+    bool UpdateColors(const TArray<FColor>& Colors);
+
+    int32 GetNumVertices() const;
+
+    // Cook collision off the game thread; the previous collision stays until it finishes.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexChunkMesh")
+    bool bUseAsyncCooking = false;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexChunkMesh")
+    bool bUseComplexAsSimpleCollision = true;
+
+    //~ Begin IInterface_CollisionDataProvider Interface
+    virtual bool GetPhysicsTriMeshData(FTriMeshCollisionData* CollisionData, bool InUseAllTriData) override;
+    virtual bool ContainsPhysicsTriMeshData(bool InUseAllTriData) const override;
+    virtual bool WantsNegXTriMesh() override { return false; }
+    //~ End IInterface_CollisionDataProvider Interface
+
+    //~ Begin UPrimitiveComponent Interface
+    virtual FPrimitiveSceneProxy* CreateSceneProxy() override;
+    virtual UBodySetup* GetBodySetup() override;
+    //~ End UPrimitiveComponent Interface
+
+    //~ Begin UMeshComponent Interface
+    virtual int32 GetNumMaterials() const override { return 1; }
+    //~ End UMeshComponent Interface
+
+private:
+    //~ Begin USceneComponent Interface
+    virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
+    //~ End USceneComponent Interface
+
+    void UpdateLocalBounds();
+    void UpdateCollision();
+    UBodySetup* CreateBodySetup();
+    void FinishPhysicsAsyncCook(bool bSuccess, UBodySetup* FinishedBodySetup);
+
+    TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe> Mesh;
+    FBox LocalBounds = FBox(ForceInit);
+    bool bComplexCollision = false;
+    bool bHasCollision = false;
+
+    UPROPERTY(Transient)
+    TObjectPtr<UBodySetup> BodySetup;
+
+    // Body setups still cooking; the newest one to finish replaces BodySetup.
+    UPROPERTY(Transient)
+    TArray<TObjectPtr<UBodySetup>> AsyncBodySetupQueue;
+};
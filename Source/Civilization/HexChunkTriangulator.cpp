@@ -0,0 +1,1128 @@
+#include "HexChunkTriangulator.h"
+#include "HexCellStore.h"
+#include "HexPerturbCache.h"
+#include "Misc/Crc.h"
+#include <utility>
+
+// A pre-triangulated connection edge or corner. Its geometry depends only on
+// the direction, the elevation differences between the cells involved and the
+// detail level, and its colours only on the cells' colours (or, in cell data
+// mode, on nothing), so one template serves every edge or corner with the same
+// signature. Positions are unperturbed and relative to the owning cell's
+// centre; replaying a template translates and perturbs them and copies the rest.
+struct FHexMeshTemplate
+{
+    // Vertex lerped between two perturbed points rather than perturbed itself,
+    // so it stays on the straight edge the neighbouring strip draws.
+    struct FBoundary
+    {
+        int32 Vertex;
+        FVector A;
+        FVector B;
+        float T;
+    };
+
+    TArray<FVector> Positions;
+    TArray<FColor> Colors;
+    TArray<int32> Indices;
+    TArray<FBoundary> Boundaries;
+
+    // Per vertex, which of the cell, neighbour and next neighbour fills each of
+    // the three splat slots, two bits per slot.
+    TArray<uint8> SplatRoles;
+};
+
+void FHexChunkMeshData::Reset()
+{
+    Origin = FVector::ZeroVector;
+    Positions.Reset();
+    Triangles.Reset();
+    VertexColors.Reset();
+    CellIndices.Reset();
+    CollisionPrisms.Reset();
+    Roads.Reset();
+    RawVertexCount = 0;
+    RawIndexCount = 0;
+    bWelded = false;
+    Detail = EHexChunkDetail::Full;
+}
+
+void FHexChunkMeshData::Reserve(int32 VertexCount, int32 IndexCount, bool bCellData)
+{
+    Positions.Reserve(VertexCount);
+    Triangles.Reserve(IndexCount);
+    VertexColors.Reserve(VertexCount);
+    if (bCellData)
+    {
+        CellIndices.Reserve(VertexCount);
+    }
+}
+
+FHexPackedPosition FHexChunkMeshData::PackPosition(const FVector& Position) const
+{
+    // -MAX_int16, not MIN_int16: SNORM reads both as -1, which would break the
+    // symmetric scale the GPU decodes with.
+    const FVector Local = (Position - Origin) * PositionPrecision;
+    FHexPackedPosition Packed;
+    Packed.X = static_cast<int16>(FMath::Clamp<int32>(FMath::RoundToInt(Local.X), -MAX_int16, MAX_int16));
+    Packed.Y = static_cast<int16>(FMath::Clamp<int32>(FMath::RoundToInt(Local.Y), -MAX_int16, MAX_int16));
+    Packed.Z = static_cast<int16>(FMath::Clamp<int32>(FMath::RoundToInt(Local.Z), -MAX_int16, MAX_int16));
+    return Packed;
+}
+
+FVector FHexChunkMeshData::GetPosition(int32 Vertex) const
+{
+    const FHexPackedPosition& Packed = Positions[Vertex];
+    return Origin + FVector(Packed.X, Packed.Y, Packed.Z) / PositionPrecision;
+}
+
+void FHexChunkMeshData::AddPositions(const FVector* InPositions, int32 Count)
+{
+    for (int32 i = 0; i < Count; i++)
+    {
+        Positions.Add(PackPosition(InPositions[i]));
+    }
+}
+
+
+namespace
+{
+    struct FWeldKey
+    {
+        FHexPackedPosition Position;
+        uint32 Color;
+        FVector3f Cells;
+
+        bool operator==(const FWeldKey& Other) const
+        {
+            return Position == Other.Position && Color == Other.Color && Cells == Other.Cells;
+        }
+
+        friend uint32 GetTypeHash(const FWeldKey& Key)
+        {
+            const uint32 PositionHash = HashCombineFast(static_cast<uint16>(Key.Position.X) | (static_cast<uint32>(static_cast<uint16>(Key.Position.Y)) << 16),
+                static_cast<uint16>(Key.Position.Z));
+            return HashCombineFast(HashCombineFast(PositionHash, Key.Color), GetTypeHash(Key.Cells));
+        }
+    };
+
+    enum EHexTemplateKind : uint8
+    {
+        EdgeTemplate,
+        CornerTemplate
+    };
+
+    // Signature of an edge or corner. Compared and hashed bytewise, so it is
+    // zeroed before being filled in and has no padding.
+    struct FHexTemplateKey
+    {
+        uint8 Kind;
+        uint8 Direction;
+        uint8 Detail;
+        uint8 bCellData;
+        int32 TerracesPerSlope;
+        int32 NeighborDelta;
+        int32 NextNeighborDelta;
+        uint32 PaletteId;
+        uint8 ColorIndices[4];
+
+        bool operator==(const FHexTemplateKey& Other) const { return FMemory::Memcmp(this, &Other, sizeof(*this)) == 0; }
+        friend uint32 GetTypeHash(const FHexTemplateKey& Key) { return FCrc::MemCrc32(&Key, sizeof(Key)); }
+    };
+    static_assert(sizeof(FHexTemplateKey) == 24, "FHexTemplateKey must not have padding");
+
+    // Templates kept per worker thread. Painted maps can produce many colour
+    // signatures, so the cache starts over once it holds this many.
+    constexpr int32 MaxCachedTemplates = 4096;
+
+    TMap<FHexTemplateKey, FHexMeshTemplate>& GetTemplateCache()
+    {
+        static thread_local TMap<FHexTemplateKey, FHexMeshTemplate> Cache;
+        return Cache;
+    }
+
+    // Pooled meshes kept for reuse. Beyond this many, released meshes are freed.
+    constexpr int32 MaxPooledMeshes = 64;
+
+    // Terrace interpolation for a fixed number of terraces per slope. Same
+    // weights as HexMetrics::TerraceLerp, but computed at compile time so the
+    // unrolled kernels below carry them as constants.
+    template <int32 InTerracesPerSlope>
+    struct THexTerraces
+    {
+        static constexpr int32 Steps = InTerracesPerSlope * 2 + 1;
+
+        static constexpr float Horizontal(int32 Step) { return float(Step) / float(Steps); }
+        static constexpr float Vertical(int32 Step) { return float((Step + 1) / 2) / float(InTerracesPerSlope + 1); }
+
+        template <int32 Step>
+        static FVector Lerp(const FVector& A, const FVector& B)
+        {
+            constexpr float H = Horizontal(Step);
+            constexpr float V = Vertical(Step);
+            return FVector(A.X + (B.X - A.X) * H, A.Y + (B.Y - A.Y) * H, A.Z + (B.Z - A.Z) * V);
+        }
+
+        template <int32 Step>
+        static HexMetrics::FEdgeVertices Lerp(const HexMetrics::FEdgeVertices& A, const HexMetrics::FEdgeVertices& B)
+        {
+            HexMetrics::FEdgeVertices Result;
+            Result.V1 = Lerp<Step>(A.V1, B.V1);
+            Result.V2 = Lerp<Step>(A.V2, B.V2);
+            Result.V3 = Lerp<Step>(A.V3, B.V3);
+            Result.V4 = Lerp<Step>(A.V4, B.V4);
+            Result.V5 = Lerp<Step>(A.V5, B.V5);
+            return Result;
+        }
+    };
+
+    // Calls Body(std::integral_constant<int32, Step>()) for Step = 1 .. Steps - 1,
+    // the interior terrace steps, unrolled.
+    template <int32 Steps, typename FunctionType, int32... Indices>
+    FORCEINLINE void ForEachTerraceStep(FunctionType&& Body, std::integer_sequence<int32, Indices...>)
+    {
+        (Body(std::integral_constant<int32, Indices + 1>()), ...);
+    }
+
+    template <int32 Steps, typename FunctionType>
+    FORCEINLINE void ForEachTerraceStep(FunctionType&& Body)
+    {
+        ForEachTerraceStep<Steps>(Forward<FunctionType>(Body), std::make_integer_sequence<int32, Steps - 1>());
+    }
+
+    FCriticalSection MeshPoolLock;
+    TArray<FHexChunkMeshData*> MeshPool;
+}
+
+TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe> FHexChunkMeshPool::Acquire()
+{
+    FHexChunkMeshData* Mesh = nullptr;
+    {
+        FScopeLock Lock(&MeshPoolLock);
+        if (MeshPool.Num() > 0)
+        {
+            Mesh = MeshPool.Pop(EAllowShrinking::No);
+        }
+    }
+    if (!Mesh)
+    {
+        Mesh = new FHexChunkMeshData();
+    }
+    return TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe>(Mesh, [](FHexChunkMeshData* Released) { Release(Released); });
+}
+
+void FHexChunkMeshPool::Release(FHexChunkMeshData* Mesh)
+{
+    Mesh->Reset();
+    {
+        FScopeLock Lock(&MeshPoolLock);
+        if (MeshPool.Num() < MaxPooledMeshes)
+        {
+            MeshPool.Add(Mesh);
+            return;
+        }
+    }
+    delete Mesh;
+}
+
+void FHexChunkMeshPool::Trim()
+{
+    TArray<FHexChunkMeshData*> Meshes;
+    {
+        FScopeLock Lock(&MeshPoolLock);
+        Meshes = MoveTemp(MeshPool);
+    }
+    for (FHexChunkMeshData* Mesh : Meshes)
+    {
+        delete Mesh;
+    }
+}
+
+void FHexChunkMeshData::Weld()
+{
+    const int32 VertexCount = Positions.Num();
+    const bool bHasCells = CellIndices.Num() == VertexCount;
+
+    // Per-thread scratch; Reset keeps the allocations for the next weld.
+    static thread_local TMap<FWeldKey, int32> Lookup;
+    static thread_local TArray<int32> Remap;
+    Lookup.Reset();
+    Lookup.Reserve(VertexCount);
+    Remap.SetNumUninitialized(VertexCount, EAllowShrinking::No);
+
+    // Unique vertices are compacted in place; the write cursor never passes the read cursor.
+    int32 WeldedCount = 0;
+    for (int32 i = 0; i < VertexCount; i++)
+    {
+        const FWeldKey Key{
+            Positions[i],
+            VertexColors[i].ToPackedARGB(),
+            bHasCells ? CellIndices[i] : FVector3f::ZeroVector };
+
+        if (const int32* Existing = Lookup.Find(Key))
+        {
+            Remap[i] = *Existing;
+            continue;
+        }
+
+        Lookup.Add(Key, WeldedCount);
+        Positions[WeldedCount] = Positions[i];
+        VertexColors[WeldedCount] = VertexColors[i];
+        if (bHasCells)
+        {
+            CellIndices[WeldedCount] = CellIndices[i];
+        }
+        Remap[i] = WeldedCount++;
+    }
+
+    Positions.SetNum(WeldedCount, EAllowShrinking::No);
+    VertexColors.SetNum(WeldedCount, EAllowShrinking::No);
+    if (bHasCells)
+    {
+        CellIndices.SetNum(WeldedCount, EAllowShrinking::No);
+    }
+
+    int32 IndexCount = 0;
+    for (int32 i = 0; i + 2 < Triangles.Num(); i += 3)
+    {
+        const int32 A = Remap[Triangles[i]];
+        const int32 B = Remap[Triangles[i + 1]];
+        const int32 C = Remap[Triangles[i + 2]];
+        if (A == B || B == C || A == C)
+        {
+            continue;
+        }
+        Triangles[IndexCount++] = A;
+        Triangles[IndexCount++] = B;
+        Triangles[IndexCount++] = C;
+    }
+    Triangles.SetNum(IndexCount, EAllowShrinking::No);
+    bWelded = true;
+}
+
+void FHexChunkTriangulator::BeginMesh(const TArray<int32>& Cells)
+{
+    Mesh.Reset();
+    Mesh.Detail = Detail;
+
+    // Positions are packed around the first cell's centre at elevation zero.
+    for (int32 Cell : Cells)
+    {
+        if (Store.IsValidIndex(Cell))
+        {
+            Mesh.Origin = FVector(Store.GetPosition(Cell).X, Store.GetPosition(Cell).Y, 0.0f);
+            break;
+        }
+    }
+}
+
+bool FHexChunkTriangulator::Triangulate(const TArray<int32>& Cells, const std::atomic<bool>* bCancelled)
+{
+    BeginMesh(Cells);
+
+    for (int32 Cell : Cells)
+    {
+        if (bCancelled && bCancelled->load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+
+        if (!Store.IsValidIndex(Cell)) continue;
+        FVector Center = Store.GetPosition(Cell);
+        FColor SRGBColor = GetCellVertexColor(Cell);
+
+        for (int32 i = 0; i < 6; i++)
+        {
+            EHexDirection Direction = static_cast<EHexDirection>(i);
+            HexMetrics::FEdgeVertices E = HexMetrics::FEdgeVertices(
+                Center + HexMetrics::GetFirstSolidCorner(Direction),
+                Center + HexMetrics::GetSecondSolidCorner(Direction)
+            );
+
+            SetSplatCells(Cell, Cell, Cell);
+            TriangulateEdgeFan(Center, E, SRGBColor);
+
+            if (Direction <= EHexDirection::SE)
+            {
+                TriangulateConnection(Direction, Cell, E);
+            }
+        }
+    }
+
+    Mesh.RawVertexCount = Mesh.NumVertices();
+    Mesh.RawIndexCount = Mesh.Triangles.Num();
+    return true;
+}
+
+bool FHexChunkTriangulator::TriangulateColors(const TArray<int32>& Cells, const std::atomic<bool>* bCancelled)
+{
+    TGuardValue<bool> ColorsOnlyGuard(bColorsOnly, true);
+    return Triangulate(Cells, bCancelled);
+}
+
+bool FHexChunkTriangulator::TriangulateRoads(const TArray<int32>& Cells)
+{
+    BeginMesh(Cells);
+
+    for (int32 Cell : Cells)
+    {
+        if (!Store.IsValidIndex(Cell) || !Store.HasRoad(Cell)) continue;
+        const FVector Center = Store.GetPosition(Cell);
+
+        for (int32 i = 0; i < 6; i++)
+        {
+            const EHexDirection Direction = static_cast<EHexDirection>(i);
+            if (Store.HasRoadThroughEdge(Cell, Direction))
+            {
+                TriangulateRoad(Direction, Cell, HexMetrics::FEdgeVertices(
+                    Center + HexMetrics::GetFirstSolidCorner(Direction),
+                    Center + HexMetrics::GetSecondSolidCorner(Direction)));
+            }
+        }
+    }
+
+    Mesh.RawVertexCount = Mesh.NumVertices();
+    Mesh.RawIndexCount = Mesh.Triangles.Num();
+    return Mesh.NumVertices() > 0;
+}
+
+void FHexChunkTriangulator::BuildCollisionPrisms(const TArray<int32>& Cells)
+{
+    int32 MinElevation = MAX_int32;
+    for (int32 Cell : Cells)
+    {
+        if (Store.IsValidIndex(Cell))
+        {
+            MinElevation = FMath::Min(MinElevation, Store.GetElevation(Cell));
+        }
+    }
+    const float Bottom = (MinElevation - 1) * HexMetrics::ElevationStep;
+
+    Mesh.CollisionPrisms.Reset(Cells.Num());
+    for (int32 Cell : Cells)
+    {
+        if (!Store.IsValidIndex(Cell)) continue;
+
+        const FVector Center = Store.GetPosition(Cell);
+        TArray<FVector>& Prism = Mesh.CollisionPrisms.AddDefaulted_GetRef();
+        Prism.Reserve(12);
+        for (int32 i = 0; i < 6; i++)
+        {
+            const FVector Corner = Center + HexMetrics::Corners[i];
+            Prism.Add(Corner);
+            Prism.Add(FVector(Corner.X, Corner.Y, Bottom));
+        }
+    }
+}
+
+void FHexChunkTriangulator::SetSplatCells(int32 A, int32 B, int32 C)
+{
+    SplatCells[0] = A;
+    SplatCells[1] = B;
+    SplatCells[2] = C;
+}
+
+FLinearColor FHexChunkTriangulator::GetCellColor(int32 Cell) const
+{
+    if (!bCellData)
+    {
+        return Store.GetColor(Cell);
+    }
+
+    if (Cell == SplatCells[0]) return FLinearColor(1.0f, 0.0f, 0.0f);
+    if (Cell == SplatCells[1]) return FLinearColor(0.0f, 1.0f, 0.0f);
+    if (Cell == SplatCells[2]) return FLinearColor(0.0f, 0.0f, 1.0f);
+    return FLinearColor(0.0f, 0.0f, 0.0f);
+}
+
+FColor FHexChunkTriangulator::GetCellVertexColor(int32 Cell) const
+{
+    return bCellData ? ToVertexColor(GetCellColor(Cell)) : Store.GetVertexColor(Cell);
+}
+
+template <int32 Terraces>
+void FHexChunkTriangulator::MakeTerraceColors(int32 BeginCell, int32 EndCell, FColor* OutColors) const
+{
+    constexpr int32 Steps = THexTerraces<Terraces>::Steps;
+    if (!bCellData)
+    {
+        if (const FColor* Blend = Store.GetPalette().GetTerraceColors(Store.GetColorIndex(BeginCell), Store.GetColorIndex(EndCell), Terraces))
+        {
+            FMemory::Memcpy(OutColors, Blend, (Steps + 1) * sizeof(FColor));
+            return;
+        }
+    }
+
+    const FLinearColor A = GetCellColor(BeginCell);
+    const FLinearColor B = GetCellColor(EndCell);
+    OutColors[0] = ToVertexColor(A);
+    for (int32 i = 1; i < Steps; i++)
+    {
+        // Weights must blend linearly; HSV blending only makes sense for real colours.
+        const float H = THexTerraces<Terraces>::Horizontal(i);
+        OutColors[i] = ToVertexColor(bCellData ? FMath::Lerp(A, B, H) : FLinearColor::LerpUsingHSV(A, B, H));
+    }
+    OutColors[Steps] = ToVertexColor(B);
+}
+
+FColor FHexChunkTriangulator::ToVertexColor(const FLinearColor& Color) const
+{
+    return Color.ToFColor(!bCellData);
+}
+
+void FHexChunkTriangulator::AddCellIndices(int32 Count)
+{
+    if (!bCellData)
+    {
+        return;
+    }
+
+    const FVector3f Cells(
+        (float)Store.GetMapIndex(SplatCells[0]),
+        (float)Store.GetMapIndex(SplatCells[1]),
+        (float)Store.GetMapIndex(SplatCells[2]));
+    for (int32 i = 0; i < Count; i++)
+    {
+        Mesh.CellIndices.Add(Cells);
+    }
+}
+
+FVector FHexChunkTriangulator::Perturb(const FVector& Position) const
+{
+    FVector Result = Position;
+    Perturb(&Result, 1);
+    return Result;
+}
+
+void FHexChunkTriangulator::Perturb(FVector* Positions, int32 Count) const
+{
+    if (Recording || bColorsOnly || Detail == EHexChunkDetail::LowUnperturbed)
+    {
+        return;
+    }
+
+    if (PerturbCache)
+    {
+        PerturbCache->Perturb(Positions, Count);
+    }
+    else
+    {
+        HexMetrics::PerturbBatch(Positions, Count);
+    }
+}
+
+void FHexChunkTriangulator::TriangulateCached(int32 Kind, EHexDirection Direction, const FVector& Origin, int32 Cell, int32 Neighbor, int32 NextNeighbor,
+    TFunctionRef<void()> Triangulate)
+{
+    const int32 Cells[3] = { Cell, Neighbor, NextNeighbor };
+
+    FHexTemplateKey Key;
+    FMemory::Memzero(Key);
+    Key.Kind = static_cast<uint8>(Kind);
+    Key.Direction = static_cast<uint8>(Direction);
+    Key.Detail = static_cast<uint8>(Detail);
+    Key.bCellData = bCellData;
+    Key.TerracesPerSlope = TerracesPerSlope;
+    Key.NeighborDelta = Store.GetElevation(Neighbor) - Store.GetElevation(Cell);
+    Key.NextNeighborDelta = NextNeighbor != INDEX_NONE ? Store.GetElevation(NextNeighbor) - Store.GetElevation(Cell) : 0;
+    if (!bCellData)
+    {
+        Key.PaletteId = Store.GetPalette().GetId();
+        for (int32 i = 0; i < 3; i++)
+        {
+            if (Cells[i] != INDEX_NONE)
+            {
+                Key.ColorIndices[i] = Store.GetColorIndex(Cells[i]);
+            }
+        }
+    }
+
+    TMap<FHexTemplateKey, FHexMeshTemplate>& Cache = GetTemplateCache();
+    FHexMeshTemplate* Template = Cache.Find(Key);
+    if (!Template)
+    {
+        if (Cache.Num() >= MaxCachedTemplates)
+        {
+            Cache.Reset();
+        }
+        Template = &Cache.Add(Key);
+
+        TGuardValue<FHexMeshTemplate*> RecordingGuard(Recording, Template);
+        RecordOrigin = Origin;
+        RecordCells[0] = Cell;
+        RecordCells[1] = Neighbor;
+        RecordCells[2] = NextNeighbor;
+        RecordBoundaryT = -1.0f;
+        Triangulate();
+    }
+
+    EmitTemplate(*Template, Origin, Cells);
+}
+
+void FHexChunkTriangulator::EmitTemplate(const FHexMeshTemplate& Template, const FVector& Origin, const int32 (&Cells)[3])
+{
+    Mesh.VertexColors.Append(Template.Colors);
+    if (bColorsOnly) return;
+
+    static thread_local TArray<FVector> Positions;
+    Positions.SetNumUninitialized(Template.Positions.Num(), EAllowShrinking::No);
+    for (int32 i = 0; i < Positions.Num(); i++)
+    {
+        Positions[i] = Origin + Template.Positions[i];
+    }
+    Perturb(Positions.GetData(), Positions.Num());
+    for (const FHexMeshTemplate::FBoundary& Boundary : Template.Boundaries)
+    {
+        Positions[Boundary.Vertex] = FMath::Lerp(Perturb(Origin + Boundary.A), Perturb(Origin + Boundary.B), Boundary.T);
+    }
+
+    const int32 VertexIndex = Mesh.NumVertices();
+    Mesh.AddPositions(Positions.GetData(), Positions.Num());
+    for (int32 Index : Template.Indices)
+    {
+        Mesh.Triangles.Add(VertexIndex + Index);
+    }
+
+    if (bCellData)
+    {
+        float MapIndices[3] = { 0.0f, 0.0f, 0.0f };
+        for (int32 i = 0; i < 3; i++)
+        {
+            if (Cells[i] != INDEX_NONE)
+            {
+                MapIndices[i] = (float)Store.GetMapIndex(Cells[i]);
+            }
+        }
+        for (uint8 Roles : Template.SplatRoles)
+        {
+            Mesh.CellIndices.Add(FVector3f(MapIndices[Roles & 3], MapIndices[(Roles >> 2) & 3], MapIndices[(Roles >> 4) & 3]));
+        }
+    }
+}
+
+void FHexChunkTriangulator::SetBoundary(const FVector& Boundary, const FVector& A, const FVector& B, float T)
+{
+    RecordBoundary = Boundary;
+    RecordBoundaryA = A;
+    RecordBoundaryB = B;
+    RecordBoundaryT = T;
+}
+
+void FHexChunkTriangulator::RecordPrimitive(const FVector* Vertices, int32 Count, bool bMayHaveBoundary)
+{
+    FHexMeshTemplate& Template = *Recording;
+    const int32 VertexIndex = Template.Positions.Num();
+
+    uint8 Roles = 0;
+    for (int32 Slot = 0; Slot < 3; Slot++)
+    {
+        const uint8 Role = SplatCells[Slot] == RecordCells[0] ? 0 : SplatCells[Slot] == RecordCells[1] ? 1 : 2;
+        Roles |= Role << (2 * Slot);
+    }
+
+    for (int32 i = 0; i < Count; i++)
+    {
+        if (bMayHaveBoundary && RecordBoundaryT >= 0.0f && Vertices[i] == RecordBoundary)
+        {
+            Template.Boundaries.Add({ VertexIndex + i, RecordBoundaryA - RecordOrigin, RecordBoundaryB - RecordOrigin, RecordBoundaryT });
+        }
+        Template.Positions.Add(Vertices[i] - RecordOrigin);
+        Template.SplatRoles.Add(Roles);
+    }
+
+    if (Count == 3)
+    {
+        Template.Indices.Append({ VertexIndex, VertexIndex + 1, VertexIndex + 2 });
+    }
+    else
+    {
+        Template.Indices.Append({ VertexIndex, VertexIndex + 2, VertexIndex + 1, VertexIndex + 1, VertexIndex + 2, VertexIndex + 3 });
+    }
+}
+
+TArray<FColor>& FHexChunkTriangulator::GetColorOutput()
+{
+    return Recording ? Recording->Colors : Mesh.VertexColors;
+}
+
+void FHexChunkTriangulator::AddTriangle(FVector V1, FVector V2, FVector V3)
+{
+    if (Recording)
+    {
+        const FVector Vertices[3] = { V1, V2, V3 };
+        RecordPrimitive(Vertices, 3, false);
+        return;
+    }
+    if (bColorsOnly) return;
+
+    int32 VertexIndex = Mesh.NumVertices();
+    FVector Perturbed[3] = { V1, V2, V3 };
+    Perturb(Perturbed, 3);
+    Mesh.AddPositions(Perturbed, 3);
+    AddCellIndices(3);
+
+    Mesh.Triangles.Add(VertexIndex);
+    Mesh.Triangles.Add(VertexIndex + 1);
+    Mesh.Triangles.Add(VertexIndex + 2);
+}
+
+void FHexChunkTriangulator::AddTriangleColor(FColor C1, FColor C2, FColor C3)
+{
+    TArray<FColor>& Colors = GetColorOutput();
+    Colors.Add(C1);
+    Colors.Add(C2);
+    Colors.Add(C3);
+}
+
+void FHexChunkTriangulator::AddTriangleColor(FColor Color)
+{
+    TArray<FColor>& Colors = GetColorOutput();
+    Colors.Add(Color);
+    Colors.Add(Color);
+    Colors.Add(Color);
+}
+
+void FHexChunkTriangulator::AddQuad(FVector V1, FVector V2, FVector V3, FVector V4)
+{
+    if (Recording)
+    {
+        const FVector Vertices[4] = { V1, V2, V3, V4 };
+        RecordPrimitive(Vertices, 4, false);
+        return;
+    }
+    if (bColorsOnly) return;
+
+    int32 VertexIndex = Mesh.NumVertices();
+    FVector Perturbed[4] = { V1, V2, V3, V4 };
+    Perturb(Perturbed, 4);
+    Mesh.AddPositions(Perturbed, 4);
+    AddCellIndices(4);
+
+    Mesh.Triangles.Add(VertexIndex);
+    Mesh.Triangles.Add(VertexIndex + 2);
+    Mesh.Triangles.Add(VertexIndex + 1);
+    Mesh.Triangles.Add(VertexIndex + 1);
+    Mesh.Triangles.Add(VertexIndex + 2);
+    Mesh.Triangles.Add(VertexIndex + 3);
+}
+
+void FHexChunkTriangulator::AddQuadColor(FColor C1, FColor C2, FColor C3, FColor C4)
+{
+    TArray<FColor>& Colors = GetColorOutput();
+    Colors.Add(C1);
+    Colors.Add(C2);
+    Colors.Add(C3);
+    Colors.Add(C4);
+}
+
+void FHexChunkTriangulator::AddQuadColor(FColor C1, FColor C2)
+{
+    TArray<FColor>& Colors = GetColorOutput();
+    Colors.Add(C1);
+    Colors.Add(C1);
+    Colors.Add(C2);
+    Colors.Add(C2);
+}
+
+void FHexChunkTriangulator::AddQuadColor(FColor Color)
+{
+    TArray<FColor>& Colors = GetColorOutput();
+    Colors.Add(Color);
+    Colors.Add(Color);
+    Colors.Add(Color);
+    Colors.Add(Color);
+}
+
+void FHexChunkTriangulator::TriangulateEdgeFan(FVector Center, HexMetrics::FEdgeVertices Edge, FColor Color)
+{
+    if (IsLowDetail())
+    {
+        AddTriangle(Center, Edge.V1, Edge.V5);
+        AddTriangleColor(Color);
+        return;
+    }
+
+    AddTriangle(Center, Edge.V1, Edge.V2);
+    AddTriangleColor(Color);
+    AddTriangle(Center, Edge.V2, Edge.V3);
+    AddTriangleColor(Color);
+    AddTriangle(Center, Edge.V3, Edge.V4);
+    AddTriangleColor(Color);
+    AddTriangle(Center, Edge.V4, Edge.V5);
+    AddTriangleColor(Color);
+}
+
+void FHexChunkTriangulator::TriangulateEdgeStrip(HexMetrics::FEdgeVertices E1, FColor C1, HexMetrics::FEdgeVertices E2, FColor C2)
+{
+    if (IsLowDetail())
+    {
+        AddQuad(E1.V1, E1.V5, E2.V1, E2.V5);
+        AddQuadColor(C1, C2);
+        return;
+    }
+
+    AddQuad(E1.V1, E1.V2, E2.V1, E2.V2);
+    AddQuadColor(C1, C2);
+    AddQuad(E1.V2, E1.V3, E2.V2, E2.V3);
+    AddQuadColor(C1, C2);
+    AddQuad(E1.V3, E1.V4, E2.V3, E2.V4);
+    AddQuadColor(C1, C2);
+    AddQuad(E1.V4, E1.V5, E2.V4, E2.V5);
+    AddQuadColor(C1, C2);
+}
+
+void FHexChunkTriangulator::TriangulateConnection(EHexDirection Direction, int32 Cell, HexMetrics::FEdgeVertices E1)
+{
+    int32 Neighbor = Store.GetNeighbor(Cell, Direction);
+    if (Neighbor == INDEX_NONE) return;
+
+    const FVector Center = Store.GetPosition(Cell);
+    TriangulateCached(EdgeTemplate, Direction, Center, Cell, Neighbor, INDEX_NONE,
+        [&]() { TriangulateConnectionEdge(Direction, Cell, Neighbor, E1); });
+
+    int32 NextNeighbor = Store.GetNeighbor(Cell, static_cast<EHexDirection>((static_cast<int32>(Direction) + 1) % 6));
+    if (Direction <= EHexDirection::E && NextNeighbor != INDEX_NONE)
+    {
+        TriangulateCached(CornerTemplate, Direction, Center, Cell, Neighbor, NextNeighbor,
+            [&]() { TriangulateConnectionCorner(Direction, Cell, Neighbor, NextNeighbor, E1); });
+    }
+}
+
+void FHexChunkTriangulator::TriangulateConnectionEdge(EHexDirection Direction, int32 Cell, int32 Neighbor, const HexMetrics::FEdgeVertices& E1)
+{
+    SetSplatCells(Cell, Neighbor, Cell);
+
+    FVector Bridge = HexMetrics::GetBridge(Direction);
+    Bridge.Z = Store.GetPosition(Neighbor).Z - Store.GetPosition(Cell).Z;
+    HexMetrics::FEdgeVertices E2 = HexMetrics::FEdgeVertices(E1.V1 + Bridge, E1.V5 + Bridge, 1.0f / 6.0f);
+
+    if (Store.GetEdgeType(Cell, Direction) == HexMetrics::EHexEdgeType::Slope && !IsLowDetail())
+    {
+        TriangulateEdgeTerraces(E1, Cell, E2, Neighbor);
+    }
+    else
+    {
+        TriangulateEdgeStrip(E1, GetCellVertexColor(Cell), E2, GetCellVertexColor(Neighbor));
+    }
+}
+
+void FHexChunkTriangulator::TriangulateConnectionCorner(EHexDirection Direction, int32 Cell, int32 Neighbor, int32 NextNeighbor, const HexMetrics::FEdgeVertices& E1)
+{
+    FVector Bridge = HexMetrics::GetBridge(Direction);
+    Bridge.Z = Store.GetPosition(Neighbor).Z - Store.GetPosition(Cell).Z;
+    const FVector E2V5 = E1.V5 + Bridge;
+
+    FVector V5 = E1.V5 + HexMetrics::GetBridge(static_cast<EHexDirection>((static_cast<int32>(Direction) + 1) % 6));
+    V5.Z = Store.GetPosition(NextNeighbor).Z;
+
+    const int32 CellElevation = Store.GetElevation(Cell);
+    const int32 NeighborElevation = Store.GetElevation(Neighbor);
+    const int32 NextNeighborElevation = Store.GetElevation(NextNeighbor);
+
+    if (CellElevation <= NeighborElevation)
+    {
+        if (CellElevation <= NextNeighborElevation)
+        {
+            TriangulateCorner(E1.V5, Cell, E2V5, Neighbor, V5, NextNeighbor);
+        }
+        else
+        {
+            TriangulateCorner(V5, NextNeighbor, E1.V5, Cell, E2V5, Neighbor);
+        }
+    }
+    else if (NeighborElevation <= NextNeighborElevation)
+    {
+        TriangulateCorner(E2V5, Neighbor, V5, NextNeighbor, E1.V5, Cell);
+    }
+    else
+    {
+        TriangulateCorner(V5, NextNeighbor, E1.V5, Cell, E2V5, Neighbor);
+    }
+}
+
+void FHexChunkTriangulator::TriangulateEdgeTerraces(HexMetrics::FEdgeVertices Begin, int32 BeginCell, HexMetrics::FEdgeVertices End, int32 EndCell)
+{
+    switch (TerracesPerSlope)
+    {
+    case 1: TriangulateEdgeTerraces<1>(Begin, BeginCell, End, EndCell); break;
+    case 3: TriangulateEdgeTerraces<3>(Begin, BeginCell, End, EndCell); break;
+    case 4: TriangulateEdgeTerraces<4>(Begin, BeginCell, End, EndCell); break;
+    default: TriangulateEdgeTerraces<2>(Begin, BeginCell, End, EndCell); break;
+    }
+}
+
+template <int32 Terraces>
+void FHexChunkTriangulator::TriangulateEdgeTerraces(const HexMetrics::FEdgeVertices& Begin, int32 BeginCell, const HexMetrics::FEdgeVertices& End, int32 EndCell)
+{
+    using FTerraces = THexTerraces<Terraces>;
+
+    FColor Colors[FTerraces::Steps + 1];
+    MakeTerraceColors<Terraces>(BeginCell, EndCell, Colors);
+
+    HexMetrics::FEdgeVertices E1 = Begin;
+    ForEachTerraceStep<FTerraces::Steps>([&](auto StepConstant)
+    {
+        constexpr int32 Step = decltype(StepConstant)::value;
+        const HexMetrics::FEdgeVertices E2 = FTerraces::template Lerp<Step>(Begin, End);
+        TriangulateEdgeStrip(E1, Colors[Step - 1], E2, Colors[Step]);
+        E1 = E2;
+    });
+
+    TriangulateEdgeStrip(E1, Colors[FTerraces::Steps - 1], End, Colors[FTerraces::Steps]);
+}
+
+void FHexChunkTriangulator::TriangulateCorner(FVector Bottom, int32 BottomCell, FVector Left, int32 LeftCell, FVector Right, int32 RightCell)
+{
+    SetSplatCells(BottomCell, LeftCell, RightCell);
+    HexMetrics::EHexEdgeType LeftEdgeType = Store.GetEdgeType(BottomCell, LeftCell);
+    HexMetrics::EHexEdgeType RightEdgeType = Store.GetEdgeType(BottomCell, RightCell);
+
+    if (IsLowDetail())
+    {
+        AddTriangle(Bottom, Left, Right);
+        AddTriangleColor(GetCellVertexColor(BottomCell), GetCellVertexColor(LeftCell), GetCellVertexColor(RightCell));
+    }
+    else if (LeftEdgeType == HexMetrics::EHexEdgeType::Slope)
+    {
+        if (RightEdgeType == HexMetrics::EHexEdgeType::Slope)
+        {
+            TriangulateCornerTerraces(Bottom, BottomCell, Left, LeftCell, Right, RightCell);
+        }
+        else if (RightEdgeType == HexMetrics::EHexEdgeType::Flat)
+        {
+            TriangulateCornerTerraces(Left, LeftCell, Right, RightCell, Bottom, BottomCell);
+        }
+        else
+        {
+            TriangulateCornerTerracesCliff(Bottom, BottomCell, Left, LeftCell, Right, RightCell);
+        }
+    }
+    else if (RightEdgeType == HexMetrics::EHexEdgeType::Slope)
+    {
+        if (LeftEdgeType == HexMetrics::EHexEdgeType::Flat)
+        {
+            TriangulateCornerTerraces(Right, RightCell, Bottom, BottomCell, Left, LeftCell);
+        }
+        else
+        {
+            TriangulateCornerCliffTerraces(Bottom, BottomCell, Left, LeftCell, Right, RightCell);
+        }
+    }
+    else if (Store.GetEdgeType(LeftCell, RightCell) == HexMetrics::EHexEdgeType::Slope)
+    {
+        if (Store.GetElevation(LeftCell) < Store.GetElevation(RightCell))
+        {
+            TriangulateCornerCliffTerraces(Right, RightCell, Bottom, BottomCell, Left, LeftCell);
+        }
+        else
+        {
+            TriangulateCornerTerracesCliff(Left, LeftCell, Right, RightCell, Bottom, BottomCell);
+        }
+    }
+    else
+    {
+        AddTriangle(Bottom, Left, Right);
+        AddTriangleColor(GetCellVertexColor(BottomCell), GetCellVertexColor(LeftCell), GetCellVertexColor(RightCell));
+    }
+}
+
+void FHexChunkTriangulator::TriangulateCornerTerraces(FVector Begin, int32 BeginCell, FVector Left, int32 LeftCell, FVector Right, int32 RightCell)
+{
+    switch (TerracesPerSlope)
+    {
+    case 1: TriangulateCornerTerraces<1>(Begin, BeginCell, Left, LeftCell, Right, RightCell); break;
+    case 3: TriangulateCornerTerraces<3>(Begin, BeginCell, Left, LeftCell, Right, RightCell); break;
+    case 4: TriangulateCornerTerraces<4>(Begin, BeginCell, Left, LeftCell, Right, RightCell); break;
+    default: TriangulateCornerTerraces<2>(Begin, BeginCell, Left, LeftCell, Right, RightCell); break;
+    }
+}
+
+template <int32 Terraces>
+void FHexChunkTriangulator::TriangulateCornerTerraces(const FVector& Begin, int32 BeginCell, const FVector& Left, int32 LeftCell, const FVector& Right, int32 RightCell)
+{
+    using FTerraces = THexTerraces<Terraces>;
+
+    FColor LeftColors[FTerraces::Steps + 1];
+    FColor RightColors[FTerraces::Steps + 1];
+    MakeTerraceColors<Terraces>(BeginCell, LeftCell, LeftColors);
+    MakeTerraceColors<Terraces>(BeginCell, RightCell, RightColors);
+
+    FVector V3 = FTerraces::template Lerp<1>(Begin, Left);
+    FVector V4 = FTerraces::template Lerp<1>(Begin, Right);
+
+    AddTriangle(Begin, V3, V4);
+    AddTriangleColor(LeftColors[0], LeftColors[1], RightColors[1]);
+
+    ForEachTerraceStep<FTerraces::Steps - 1>([&](auto StepConstant)
+    {
+        constexpr int32 Step = decltype(StepConstant)::value + 1;
+        const FVector V1 = V3;
+        const FVector V2 = V4;
+        V3 = FTerraces::template Lerp<Step>(Begin, Left);
+        V4 = FTerraces::template Lerp<Step>(Begin, Right);
+        AddQuad(V1, V2, V3, V4);
+        AddQuadColor(LeftColors[Step - 1], RightColors[Step - 1], LeftColors[Step], RightColors[Step]);
+    });
+
+    AddQuad(V3, V4, Left, Right);
+    AddQuadColor(LeftColors[FTerraces::Steps - 1], RightColors[FTerraces::Steps - 1], LeftColors[FTerraces::Steps], RightColors[FTerraces::Steps]);
+}
+
+void FHexChunkTriangulator::TriangulateCornerTerracesCliff(FVector Begin, int32 BeginCell, FVector Left, int32 LeftCell, FVector Right, int32 RightCell)
+{
+    float B = 1.0f / (Store.GetElevation(RightCell) - Store.GetElevation(BeginCell));
+    if (B < 0) B = -B;
+    FVector Boundary = FMath::Lerp(Perturb(Begin), Perturb(Right), B);
+    FLinearColor BoundaryColor = FMath::Lerp(GetCellColor(BeginCell), GetCellColor(RightCell), B);
+    SetBoundary(Boundary, Begin, Right, B);
+
+    TriangulateBoundaryTriangle(Begin, BeginCell, Left, LeftCell, Boundary, BoundaryColor);
+
+    if (Store.GetEdgeType(LeftCell, RightCell) == HexMetrics::EHexEdgeType::Slope)
+    {
+        TriangulateBoundaryTriangle(Left, LeftCell, Right, RightCell, Boundary, BoundaryColor);
+    }
+    else
+    {
+        AddTriangleUnperturbed(Perturb(Left), Perturb(Right), Boundary);
+        AddTriangleColor(GetCellVertexColor(LeftCell), GetCellVertexColor(RightCell), ToVertexColor(BoundaryColor));
+    }
+}
+
+void FHexChunkTriangulator::TriangulateCornerCliffTerraces(FVector Begin, int32 BeginCell, FVector Left, int32 LeftCell, FVector Right, int32 RightCell)
+{
+    float B = 1.0f / (Store.GetElevation(LeftCell) - Store.GetElevation(BeginCell));
+    if (B < 0) B = -B;
+    FVector Boundary = FMath::Lerp(Perturb(Begin), Perturb(Left), B);
+    FLinearColor BoundaryColor = FMath::Lerp(GetCellColor(BeginCell), GetCellColor(LeftCell), B);
+    SetBoundary(Boundary, Begin, Left, B);
+
+    TriangulateBoundaryTriangle(Right, RightCell, Begin, BeginCell, Boundary, BoundaryColor);
+
+    if (Store.GetEdgeType(LeftCell, RightCell) == HexMetrics::EHexEdgeType::Slope)
+    {
+        TriangulateBoundaryTriangle(Left, LeftCell, Right, RightCell, Boundary, BoundaryColor);
+    }
+    else
+    {
+        AddTriangleUnperturbed(Perturb(Left), Perturb(Right), Boundary);
+        AddTriangleColor(GetCellVertexColor(LeftCell), GetCellVertexColor(RightCell), ToVertexColor(BoundaryColor));
+    }
+}
+
+void FHexChunkTriangulator::TriangulateBoundaryTriangle(FVector Begin, int32 BeginCell, FVector Left, int32 LeftCell, FVector Boundary, FLinearColor BoundaryColor)
+{
+    const FColor Color = ToVertexColor(BoundaryColor);
+    switch (TerracesPerSlope)
+    {
+    case 1: TriangulateBoundaryTriangle<1>(Begin, BeginCell, Left, LeftCell, Boundary, Color); break;
+    case 3: TriangulateBoundaryTriangle<3>(Begin, BeginCell, Left, LeftCell, Boundary, Color); break;
+    case 4: TriangulateBoundaryTriangle<4>(Begin, BeginCell, Left, LeftCell, Boundary, Color); break;
+    default: TriangulateBoundaryTriangle<2>(Begin, BeginCell, Left, LeftCell, Boundary, Color); break;
+    }
+}
+
+template <int32 Terraces>
+void FHexChunkTriangulator::TriangulateBoundaryTriangle(const FVector& Begin, int32 BeginCell, const FVector& Left, int32 LeftCell, const FVector& Boundary, FColor BoundaryColor)
+{
+    using FTerraces = THexTerraces<Terraces>;
+
+    FColor Colors[FTerraces::Steps + 1];
+    MakeTerraceColors<Terraces>(BeginCell, LeftCell, Colors);
+
+    // Perturb every terrace point in one batch rather than one call per step.
+    FVector Points[FTerraces::Steps + 1];
+    Points[0] = Begin;
+    ForEachTerraceStep<FTerraces::Steps>([&](auto StepConstant)
+    {
+        constexpr int32 Step = decltype(StepConstant)::value;
+        Points[Step] = FTerraces::template Lerp<Step>(Begin, Left);
+    });
+    Points[FTerraces::Steps] = Left;
+    Perturb(Points, FTerraces::Steps + 1);
+
+    for (int32 i = 0; i < FTerraces::Steps; i++)
+    {
+        AddTriangleUnperturbed(Points[i], Points[i + 1], Boundary);
+        AddTriangleColor(Colors[i], Colors[i + 1], BoundaryColor);
+    }
+}
+
+void FHexChunkTriangulator::AddTriangleUnperturbed(FVector V1, FVector V2, FVector V3)
+{
+    if (Recording)
+    {
+        // Inputs were "perturbed" with perturbation off, so apart from the
+        // boundary they are plain positions, perturbed again on replay.
+        const FVector Vertices[3] = { V1, V2, V3 };
+        RecordPrimitive(Vertices, 3, true);
+        return;
+    }
+    if (bColorsOnly) return;
+
+    int32 VertexIndex = Mesh.NumVertices();
+    const FVector Unperturbed[3] = { V1, V2, V3 };
+    Mesh.AddPositions(Unperturbed, 3);
+    AddCellIndices(3);
+
+    Mesh.Triangles.Add(VertexIndex);
+    Mesh.Triangles.Add(VertexIndex + 1);
+    Mesh.Triangles.Add(VertexIndex + 2);
+}
+
+void FHexChunkTriangulator::TriangulateRoad(EHexDirection Direction, int32 Cell, const HexMetrics::FEdgeVertices& E)
+{
+    const FVector Lift(0.0f, 0.0f, HexMetrics::RoadElevationOffset);
+    const FVector Across = (E.V4 - E.V2) * 0.5f;
+
+    // The strip starts half a road width behind the centre, so the strips of
+    // a cell overlap there and turns get a filled corner.
+    const FVector Center = Store.GetPosition(Cell) + Lift;
+    const FVector EdgeCenter = E.V3 + Lift;
+    const FVector Inward = (Center - EdgeCenter).GetSafeNormal() * Across.Size();
+    AddRoadSegment(Center + Inward, EdgeCenter, Across);
+
+    // Like the terrain, each connection belongs to the cell on its NE, E or SE side.
+    const int32 Neighbor = Store.GetNeighbor(Cell, Direction);
+    if (Direction > EHexDirection::SE || Neighbor == INDEX_NONE)
+    {
+        return;
+    }
+
+    // The far end is the middle of the neighbour's solid edge, where its own strip ends.
+    FVector Bridge = HexMetrics::GetBridge(Direction);
+    Bridge.Z = Store.GetPosition(Neighbor).Z - Store.GetPosition(Cell).Z;
+    const FVector End = EdgeCenter + Bridge;
+
+    if (Store.GetEdgeType(Cell, Direction) != HexMetrics::EHexEdgeType::Slope || IsLowDetail())
+    {
+        AddRoadSegment(EdgeCenter, End, Across);
+        return;
+    }
+
+    // Same steps as the terrace strip underneath (see HexMetrics::TerraceLerp).
+    const int32 Steps = TerracesPerSlope * 2 + 1;
+    FVector Previous = EdgeCenter;
+    for (int32 Step = 1; Step <= Steps; Step++)
+    {
+        const float H = float(Step) / Steps;
+        const float V = float((Step + 1) / 2) / (TerracesPerSlope + 1);
+        const FVector Next(
+            EdgeCenter.X + Bridge.X * H,
+            EdgeCenter.Y + Bridge.Y * H,
+            EdgeCenter.Z + Bridge.Z * V);
+        AddRoadSegment(Previous, Next, Across);
+        Previous = Next;
+    }
+}
+
+void FHexChunkTriangulator::AddRoadSegment(const FVector& Begin, const FVector& End, const FVector& Across)
+{
+    const FColor Side(0, 0, 0);
+    const FColor Middle(255, 0, 0);
+
+    AddQuad(Begin - Across, Begin, End - Across, End);
+    AddQuadColor(Side, Middle, Side, Middle);
+    AddQuad(Begin, Begin + Across, End, End + Across);
+    AddQuadColor(Middle, Side, Middle, Side);
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HexMetrics.h"
+#include <atomic>
+
+struct FHexCellStore;
+struct FHexMeshTemplate;
+class FHexPerturbCache;
+
+// Detail level of a chunk mesh. Low detail has no terraces (slopes become one
+// strip, slope corners one triangle) and one segment per cell edge instead of
+// four, for zoomed-out views; the unperturbed variant also skips the noise.
+enum class EHexChunkDetail : uint8
+{
+    Full,
+    Low,
+    LowUnperturbed
+};
+
+// Vertex position relative to FHexChunkMeshData::Origin, in steps of
+// 1 / FHexChunkMeshData::PositionPrecision, kept within +-MAX_int16. Uploaded
+// as is and read as a normalized Short4N stream (R16G16B16A16_SNORM), which
+// the GPU sees as the value / 32767; the fourth component pads to 8 bytes and
+// is MAX_int16 so the normalized w is 1.
+struct FHexPackedPosition
+{
+    int16 X = 0;
+    int16 Y = 0;
+    int16 Z = 0;
+    int16 W = MAX_int16;
+
+    bool operator==(const FHexPackedPosition& Other) const { return X == Other.X && Y == Other.Y && Z == Other.Z; }
+};
+
+// CPU-side mesh buffers produced by FHexChunkTriangulator. Every chunk vertex
+// faces up and has no texture coordinates, so only positions, colours and
+// (in cell data mode) cell indices are stored; normals and tangents are
+// constant and supplied at upload.
+struct CIVILIZATION_API FHexChunkMeshData
+{
+    // Packed positions cover +-32767 / PositionPrecision units around Origin,
+    // enough for a chunk and its seams at any int8 elevation.
+    static constexpr float PositionPrecision = 256.0f;
+
+    FVector Origin = FVector::ZeroVector;
+    TArray<FHexPackedPosition> Positions;
+    TArray<int32> Triangles;
+    TArray<FColor> VertexColors;
+
+    // Cell data mode only: the three map cells each vertex blends between. The
+    // blend weights are in VertexColors (R, G, B).
+    TArray<FVector3f> CellIndices;
+
+    // Simplified collision only: one convex hex prism per cell.
+    TArray<TArray<FVector>> CollisionPrisms;
+
+    // Road overlay built with the terrain, drawn as its own section with the
+    // road material. Null when none of the chunk's cells has a road.
+    TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe> Roads;
+
+    // Counts as triangulated, before any welding.
+    int32 RawVertexCount = 0;
+    int32 RawIndexCount = 0;
+    bool bWelded = false;
+    EHexChunkDetail Detail = EHexChunkDetail::Full;
+
+    // Clears the buffers but keeps their allocations, so a recycled mesh
+    // refills without touching the heap.
+    void Reset();
+
+    // Grows the buffers to hold a build of the given size, usually the exact
+    // counts of the chunk's previous build.
+    void Reserve(int32 VertexCount, int32 IndexCount, bool bCellData);
+
+    int32 NumVertices() const { return Positions.Num(); }
+
+    FHexPackedPosition PackPosition(const FVector& Position) const;
+    FVector GetPosition(int32 Vertex) const;
+    void AddPositions(const FVector* InPositions, int32 Count);
+
+    // Merges vertices with the same packed position and colour and rewrites
+    // the index buffer to share them. Triangles that collapse are removed.
+    void Weld();
+};
+
+// Recycles mesh buffers between builds. A mesh from Acquire goes back to the
+// pool, reset but with its allocations, when its last reference is dropped,
+// so once the pool is warm rebuilds stop allocating. Safe on any thread.
+class CIVILIZATION_API FHexChunkMeshPool
+{
+public:
+    static TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe> Acquire();
+
+    // Frees the pooled buffers, e.g. after a large map was closed.
+    static void Trim();
+
+private:
+    static void Release(FHexChunkMeshData* Mesh);
+};
+
+// Pure-data chunk triangulation. It only reads the given cell store (usually a
+// snapshot of the chunk plus one ring of neighbours) and writes into a mesh
+// buffer, so it can run on task-graph worker threads.
+class CIVILIZATION_API FHexChunkTriangulator
+{
+public:
+    // Terrace counts with a triangulation kernel; other counts are clamped.
+    static constexpr int32 MinTerracesPerSlope = 1;
+    static constexpr int32 MaxTerracesPerSlope = 4;
+
+    // PerturbCache is optional; without it every vertex samples the noise.
+    // With bInCellData the mesh gets per-vertex cell indices and blend weights
+    // instead of colours, for materials reading the grid's cell data texture.
+    FHexChunkTriangulator(const FHexCellStore& InStore, FHexChunkMeshData& InMesh, FHexPerturbCache* InPerturbCache = nullptr, bool bInCellData = false,
+        EHexChunkDetail InDetail = EHexChunkDetail::Full, int32 InTerracesPerSlope = HexMetrics::TerracesPerSlope)
+        : Store(InStore), Mesh(InMesh), PerturbCache(InPerturbCache), bCellData(bInCellData), Detail(InDetail),
+          TerracesPerSlope(FMath::Clamp(InTerracesPerSlope, MinTerracesPerSlope, MaxTerracesPerSlope))
+    {
+    }
+
+    // Triangulates the given cells of the store. Returns false if the build was
+    // cancelled before it finished; the mesh is incomplete in that case.
+    bool Triangulate(const TArray<int32>& Cells, const std::atomic<bool>* bCancelled = nullptr);
+
+    // Same walk as Triangulate, but only VertexColors is written. As long as no
+    // elevation changed, the colours line up with the previous full build.
+    bool TriangulateColors(const TArray<int32>& Cells, const std::atomic<bool>* bCancelled = nullptr);
+
+    // Fills Mesh.CollisionPrisms with an unperturbed prism per cell, from its top
+    // down to one step below the lowest cell given.
+    void BuildCollisionPrisms(const TArray<int32>& Cells);
+
+    // Triangulates the roads of the given cells into the mesh instead of the
+    // terrain: a strip from each cell's centre to every edge a road crosses,
+    // and across the connections the cell owns, following terraces on slopes.
+    // Vertex colour R is 0 on the road's sides and 255 on its centre line.
+    // Returns false if none of the cells has a road.
+    bool TriangulateRoads(const TArray<int32>& Cells);
+
+private:
+    const FHexCellStore& Store;
+    FHexChunkMeshData& Mesh;
+    FHexPerturbCache* PerturbCache;
+    bool bColorsOnly = false;
+    bool bCellData;
+    EHexChunkDetail Detail;
+    int32 TerracesPerSlope;
+
+    bool IsLowDetail() const { return Detail != EHexChunkDetail::Full; }
+
+    // Resets the mesh and packs its positions around the first valid cell.
+    void BeginMesh(const TArray<int32>& Cells);
+
+    // Cells the current primitive blends between, by map index.
+    int32 SplatCells[3] = { INDEX_NONE, INDEX_NONE, INDEX_NONE };
+
+    // Edges and corners are triangulated once per neighbourhood signature (see
+    // FHexMeshTemplate) and replayed from a per-thread cache after that. While
+    // a template is recorded, output goes to Recording instead of the mesh,
+    // unperturbed and relative to RecordOrigin.
+    FHexMeshTemplate* Recording = nullptr;
+    FVector RecordOrigin = FVector::ZeroVector;
+    int32 RecordCells[3] = { INDEX_NONE, INDEX_NONE, INDEX_NONE };
+    FVector RecordBoundary = FVector::ZeroVector;
+    FVector RecordBoundaryA = FVector::ZeroVector;
+    FVector RecordBoundaryB = FVector::ZeroVector;
+    float RecordBoundaryT = -1.0f;
+
+    void TriangulateCached(int32 Kind, EHexDirection Direction, const FVector& Origin, int32 Cell, int32 Neighbor, int32 NextNeighbor,
+        TFunctionRef<void()> Triangulate);
+    void EmitTemplate(const FHexMeshTemplate& Template, const FVector& Origin, const int32 (&Cells)[3]);
+    void SetBoundary(const FVector& Boundary, const FVector& A, const FVector& B, float T);
+    void RecordPrimitive(const FVector* Vertices, int32 Count, bool bMayHaveBoundary);
+    TArray<FColor>& GetColorOutput();
+
+    FVector Perturb(const FVector& Position) const;
+    void Perturb(FVector* Positions, int32 Count) const;
+
+    // In cell data mode a cell's "colour" is its weight channel in SplatCells,
+    // so the usual colour blends produce blend weights.
+    void SetSplatCells(int32 A, int32 B, int32 C);
+    FLinearColor GetCellColor(int32 Cell) const;
+    // Outside cell data mode these read the palette's precomputed colours.
+    FColor GetCellVertexColor(int32 Cell) const;
+    // Vertex colours of every terrace step from BeginCell (step 0) to EndCell (the last step).
+    template <int32 Terraces>
+    void MakeTerraceColors(int32 BeginCell, int32 EndCell, FColor* OutColors) const;
+    FColor ToVertexColor(const FLinearColor& Color) const;
+    void AddCellIndices(int32 Count);
+
+    void AddTriangle(FVector V1, FVector V2, FVector V3);
+    void AddTriangleColor(FColor C1, FColor C2, FColor C3);
+    void AddTriangleColor(FColor Color);
+    void AddQuad(FVector V1, FVector V2, FVector V3, FVector V4);
+    void AddQuadColor(FColor C1, FColor C2, FColor C3, FColor C4);
+    void AddQuadColor(FColor C1, FColor C2);
+    void AddQuadColor(FColor Color);
+
+    void TriangulateEdgeFan(FVector Center, HexMetrics::FEdgeVertices Edge, FColor Color);
+    void TriangulateEdgeStrip(HexMetrics::FEdgeVertices E1, FColor C1, HexMetrics::FEdgeVertices E2, FColor C2);
+    void TriangulateConnection(EHexDirection Direction, int32 Cell, HexMetrics::FEdgeVertices E1);
+    void TriangulateConnectionEdge(EHexDirection Direction, int32 Cell, int32 Neighbor, const HexMetrics::FEdgeVertices& E1);
+    void TriangulateConnectionCorner(EHexDirection Direction, int32 Cell, int32 Neighbor, int32 NextNeighbor, const HexMetrics::FEdgeVertices& E1);
+    // The terrace functions dispatch on TerracesPerSlope to a kernel
+    // specialised for that count, with its interpolation weights folded in.
+    void TriangulateEdgeTerraces(HexMetrics::FEdgeVertices Begin, int32 BeginCell, HexMetrics::FEdgeVertices End, int32 EndCell);
+    template <int32 Terraces>
+    void TriangulateEdgeTerraces(const HexMetrics::FEdgeVertices& Begin, int32 BeginCell, const HexMetrics::FEdgeVertices& End, int32 EndCell);
+    void TriangulateCorner(FVector Bottom, int32 BottomCell, FVector Left, int32 LeftCell, FVector Right, int32 RightCell);
+    void TriangulateCornerTerraces(FVector Begin, int32 BeginCell, FVector Left, int32 LeftCell, FVector Right, int32 RightCell);
+    template <int32 Terraces>
+    void TriangulateCornerTerraces(const FVector& Begin, int32 BeginCell, const FVector& Left, int32 LeftCell, const FVector& Right, int32 RightCell);
+    void TriangulateCornerTerracesCliff(FVector Begin, int32 BeginCell, FVector Left, int32 LeftCell, FVector Right, int32 RightCell);
+    void TriangulateCornerCliffTerraces(FVector Begin, int32 BeginCell, FVector Left, int32 LeftCell, FVector Right, int32 RightCell);
+    void TriangulateBoundaryTriangle(FVector Begin, int32 BeginCell, FVector Left, int32 LeftCell, FVector Boundary, FLinearColor BoundaryColor);
+    template <int32 Terraces>
+    void TriangulateBoundaryTriangle(const FVector& Begin, int32 BeginCell, const FVector& Left, int32 LeftCell, const FVector& Boundary, FColor BoundaryColor);
+    void AddTriangleUnperturbed(FVector V1, FVector V2, FVector V3);
+
+    void TriangulateRoad(EHexDirection Direction, int32 Cell, const HexMetrics::FEdgeVertices& E);
+    // Two quads from centre line point Begin to End, Across being half the road width.
+    void AddRoadSegment(const FVector& Begin, const FVector& End, const FVector& Across);
+};
@@ -11,8 +11,6 @@ FHexCoordinates FHexCoordinates::FromPosition(FVector Position)
     X -= Offset;
     Y -= Offset;
 
-    UE_LOG(LogTemp, Log, TEXT("FromPosition: Position=(%s), Raw X=%f, Y=%f, Offset=%f"), *Position.ToString(), X, Y, Offset);
-
     int32 iX = FMath::RoundToInt(X);
     int32 iY = FMath::RoundToInt(Y);
     int32 iZ = FMath::RoundToInt(-X - Y);
@@ -23,8 +21,6 @@ FHexCoordinates FHexCoordinates::FromPosition(FVector Position)
         float dY = FMath::Abs(Y - iY);
         float dZ = FMath::Abs(-X - Y - iZ);
 
-        UE_LOG(LogTemp, Log, TEXT("Rounding deltas: dX=%f, dY=%f, dZ=%f"), dX, dY, dZ);
-
         if (dX > dY && dX > dZ)
         {
             iX = -iY - iZ;
@@ -33,26 +29,14 @@ FHexCoordinates FHexCoordinates::FromPosition(FVector Position)
         {
             iZ = -iX - iY;
         }
-
-        UE_LOG(LogTemp, Log, TEXT("Adjusted coordinates: (%d, %d, %d)"), iX, iY, iZ);
     }
 
     return FHexCoordinates(iX, iZ);
 }
 
-FHexCoordinates::FHexCoordinates(int32 InX, int32 InZ)
-    : X(InX), Z(InZ), Y(-InX - InZ)
-{
-    UE_LOG(LogTemp, Log, TEXT("Constructed FHexCoordinates: (%d, %d, %d)"), X, Y, Z);
-}
-
 FHexCoordinates FHexCoordinates::FromOffsetCoordinates(int32 OffsetX, int32 OffsetZ)
 {
-    int32 NewX = OffsetX - OffsetZ / 2;
-    int32 NewZ = OffsetZ;
-    FHexCoordinates Coords(NewX, NewZ);
-    UE_LOG(LogTemp, Log, TEXT("FromOffsetCoordinates: (%d, %d) -> (%d, %d, %d)"), OffsetX, OffsetZ, Coords.X, Coords.Y, Coords.Z);
-    return Coords;
+    return FHexCoordinates(OffsetX - OffsetZ / 2, OffsetZ);
 }
 
 FString FHexCoordinates::ToString() const
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "HexMath.h"
 #include "HexCoordinates.generated.h"
 
 USTRUCT(BlueprintType)
@@ -18,7 +19,10 @@ public:
     UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
     int32 Y;
 
-    FHexCoordinates(int32 InX = 0, int32 InZ = 0);
+    FHexCoordinates(int32 InX = 0, int32 InZ = 0) : X(InX), Z(InZ), Y(-InX - InZ) {}
+    explicit FHexCoordinates(const FHexAxial& Axial) : FHexCoordinates(Axial.X, Axial.Z) {}
+
+    FHexAxial ToAxial() const { return FHexAxial(X, Z); }
 
     static FHexCoordinates FromOffsetCoordinates(int32 OffsetX, int32 OffsetZ);
     static FHexCoordinates FromPosition(FVector Position);
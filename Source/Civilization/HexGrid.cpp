@@ -3,10 +3,101 @@
 #include "HexMetrics.h"
 #include "HexCoordinates.h"
 #include "HexGridChunk.h"
+#include "HexChunkTriangulator.h"
+#include "Engine/Texture2D.h"
+#include "Materials/MaterialInstanceDynamic.h"
+#include "Misc/Paths.h"
+#include "Async/ParallelFor.h"
+#include "Camera/PlayerCameraManager.h"
+#include "GameFramework/PlayerController.h"
+#include "Engine/StaticMesh.h"
+#include "UObject/ConstructorHelpers.h"
 
 AHexGrid::AHexGrid()
 {
-    PrimaryActorTick.bCanEverTick = false;
+    PrimaryActorTick.bCanEverTick = true;
+    // Flush after gameplay and editor components have applied this frame's edits.
+    PrimaryActorTick.TickGroup = TG_PostUpdateWork;
+
+    static ConstructorHelpers::FObjectFinder<UStaticMesh> CellInstanceMeshFinder(TEXT("/Game/mesh/hex.hex"));
+    CellInstanceMesh = CellInstanceMeshFinder.Succeeded() ? CellInstanceMeshFinder.Object : nullptr;
+}
+
+void AHexGrid::SetTerracesPerSlope(int32 Count)
+{
+    Count = FMath::Clamp(Count, FHexChunkTriangulator::MinTerracesPerSlope, FHexChunkTriangulator::MaxTerracesPerSlope);
+    if (Count != TerracesPerSlope)
+    {
+        TerracesPerSlope = Count;
+        UpdateCellPalette();
+        Refresh();
+    }
+}
+
+void AHexGrid::SetCellPalette(const TArray<FLinearColor>& Colors)
+{
+    // The mapped file's palette sits in its header, ahead of the block table,
+    // and only the records are mapped; its cells would come back in the old
+    // colours, or in none if the palette grew.
+    if (MapMapping)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("SetCellPalette: %s is mapped; close it before changing the palette"), *MapMapping->GetPath());
+        return;
+    }
+
+    CellPalette = Colors;
+    UpdateCellPalette();
+    if (CellDataTexture)
+    {
+        for (int32 CellIndex = 0; CellIndex < CellStore.Num(); CellIndex++)
+        {
+            MarkCellDataDirty(CellIndex);
+        }
+    }
+
+    // Cell instances bake palette colours into their custom data, texture or not.
+    if (!CellDataTexture || UsesCellInstances())
+    {
+        for (int32 ChunkIndex = 0; ChunkIndex < Chunks.Num(); ChunkIndex++)
+        {
+            if (Chunks[ChunkIndex])
+            {
+                MarkChunkDirty(ChunkIndex, true);
+            }
+        }
+    }
+
+    OnCellPaletteChanged.Broadcast();
+}
+
+void AHexGrid::UpdateCellPalette()
+{
+    CellStore.SetPalette(MakeShared<const FHexCellPalette, ESPMode::ThreadSafe>(CellPalette, TerracesPerSlope));
+}
+
+void AHexGrid::SetChunkRenderMode(EHexChunkRenderMode Mode)
+{
+    if (Mode != ChunkRenderMode)
+    {
+        ChunkRenderMode = Mode;
+        Refresh();
+    }
+}
+
+bool AHexGrid::UsesCellInstances() const
+{
+    return ChunkRenderMode == EHexChunkRenderMode::Instanced ||
+        (ChunkRenderMode == EHexChunkRenderMode::InstancedWhenZoomedOut && ChunkDetail != EHexChunkDetail::Full);
+}
+
+void AHexGrid::Tick(float DeltaTime)
+{
+    Super::Tick(DeltaTime);
+    UpdateView();
+    UpdateChunkStreaming();
+    StreamMapBlocks();
+    FlushDirtyChunks();
+    FlushCellData();
 }
 
 void AHexGrid::BeginPlay()
@@ -32,6 +123,8 @@ void AHexGrid::BeginPlay()
         int32 TexWidth = Mip.SizeX;
         int32 TexHeight = Mip.SizeY;
         HexMetrics::NoiseData.SetNum(TexWidth * TexHeight);
+        HexMetrics::NoiseWidth = TexWidth;
+        HexMetrics::NoiseHeight = TexHeight;
 
         for (int32 Y = 0; Y < TexHeight; Y++)
         {
@@ -45,85 +138,42 @@ void AHexGrid::BeginPlay()
         }
         BulkData.Unlock();
     }
+    HexMetrics::BuildNoiseField();
+    HexMetrics::InvalidateNoise();
 
+    // Chunks in the working set are triangulated on the first tick.
+    UpdateCellPalette();
     CreateChunks();
     CreateCells();
-
-    TriangulateCells();
+    if (bUseCellDataTexture)
+    {
+        CreateCellDataTexture();
+    }
 }
 
 void AHexGrid::CreateCells()
 {
-    if (!CellClass)
-    {
-        UE_LOG(LogTemp, Error, TEXT("CellClass is not set!"));
-        return;
-    }
-
-    for (AHexCell* Cell : Cells)
+    for (const TPair<int32, AHexCell*>& Pair : CellProxies)
     {
-        if (Cell)
+        if (Pair.Value)
         {
-            Cell->Destroy();
+            Pair.Value->Destroy();
         }
     }
-    Cells.Empty();
-    Cells.SetNum(Width * Height);
+    CellProxies.Empty();
 
-    const float SpacingFactor = 1.0f;
+    CellStore.Init(Width, Height);
+    bElevationBoundsDirty = true;
 
     for (int32 Z = 0, I = 0; Z < Height; Z++)
     {
-        for (int32 X = 0; X < Width; X++)
+        for (int32 X = 0; X < Width; X++, I++)
         {
-            float PosX = (X + Z * 0.5f - Z / 2) * (HexMetrics::InnerRadius * 2.0f) * SpacingFactor;
-            float PosY = Z * (HexMetrics::OuterRadius * 1.5f) * SpacingFactor;
-            FVector Position(PosX, PosY, 0.0f);
-
-            AHexCell* Cell = GetWorld()->SpawnActor<AHexCell>(CellClass, Position, FRotator::ZeroRotator);
-            if (Cell)
-            {
-                Cell->SetupCell(X, Z, Position);
-                Cell->SetElevation(0);
-                Cells[I] = Cell;
-
-                if (X > 0)
-                {
-                    Cell->SetNeighbor(EHexDirection::W, Cells[I - 1]);
-                }
-
-                if (Z > 0)
-                {
-                    if ((Z & 1) == 0)
-                    {
-                        Cell->SetNeighbor(EHexDirection::SE, Cells[I - Width]);
-                        if (X > 0)
-                        {
-                            Cell->SetNeighbor(EHexDirection::SW, Cells[I - Width - 1]);
-                        }
-                    }
-                    else
-                    {
-                        Cell->SetNeighbor(EHexDirection::SW, Cells[I - Width]);
-                        if (X < Width - 1)
-                        {
-                            Cell->SetNeighbor(EHexDirection::SE, Cells[I - Width + 1]);
-                        }
-                    }
-                }
-
-                AddCellToChunk(X, Z, Cell);
-                I++;
-                UE_LOG(LogTemp, Log, TEXT("Spawned HexCell at (%d, %d)"), X, Z);
-            }
-            else
-            {
-                UE_LOG(LogTemp, Error, TEXT("Failed to spawn HexCell at (%d, %d). CellClass: %s"), X, Z, *GetNameSafe(CellClass));
-            }
+            AddCellToChunk(X, Z, I);
         }
     }
 
-    UE_LOG(LogTemp, Log, TEXT("Total Cells: %d"), Cells.Num());
+    UE_LOG(LogTemp, Log, TEXT("Total Cells: %d"), CellStore.Num());
 }
 
 void AHexGrid::TriangulateCells()
@@ -137,96 +187,1202 @@ void AHexGrid::TriangulateCells()
     }
 }
 
-AHexCell* AHexGrid::GetCellByPosition(FVector Position)
+int32 AHexGrid::GetCellIndexByPosition(FVector Position) const
 {
     FVector LocalPosition = GetActorTransform().InverseTransformPosition(Position);
     FHexCoordinates Coordinates = FHexCoordinates::FromPosition(LocalPosition);
-    UE_LOG(LogTemp, Log, TEXT("Touched at (%d, %d, %d)"), Coordinates.X, Coordinates.Y, Coordinates.Z);
+    UE_LOG(LogTemp, Verbose, TEXT("Touched at (%d, %d, %d)"), Coordinates.X, Coordinates.Y, Coordinates.Z);
 
     int32 OffsetX = Coordinates.X + (Coordinates.Z - (Coordinates.Z & 1)) / 2;
     int32 OffsetZ = Coordinates.Z;
 
-    if (OffsetX < 0 || OffsetX >= Width || OffsetZ < 0 || OffsetZ >= Height)
+    if (!CellStore.IsValidOffset(OffsetX, OffsetZ))
     {
         UE_LOG(LogTemp, Warning, TEXT("Coordinates (%d, %d) out of bounds!"), OffsetX, OffsetZ);
-        return nullptr;
+        return INDEX_NONE;
+    }
+
+    return CellStore.GetIndex(OffsetX, OffsetZ);
+}
+
+namespace
+{
+    FVector2D GetAxialCenter(const FHexAxial& Cell)
+    {
+        return FVector2D((Cell.X + Cell.Z * 0.5f) * (HexMetrics::InnerRadius * 2.0f), Cell.Z * (HexMetrics::OuterRadius * 1.5f));
+    }
+
+    FHexAxial GetAxialCell(const FVector2D& Position)
+    {
+        const float Z = Position.Y / (HexMetrics::OuterRadius * 1.5f);
+        const float X = Position.X / (HexMetrics::InnerRadius * 2.0f) - Z * 0.5f;
+        return HexMath::Round(X, Z);
     }
+}
 
-    int32 Index = OffsetX + OffsetZ * Width;
-    if (Index >= 0 && Index < Cells.Num() && Cells[Index])
+void AHexGrid::UpdateElevationBounds() const
+{
+    if (!bElevationBoundsDirty)
     {
-        UE_LOG(LogTemp, Log, TEXT("Found cell at index %d, coordinates (%d, %d)"), Index, OffsetX, OffsetZ);
-        return Cells[Index];
+        return;
     }
 
-    UE_LOG(LogTemp, Warning, TEXT("No cell found at coordinates (%d, %d)"), Coordinates.X, Coordinates.Z);
-    return nullptr;
+    MinCellElevation = MAX_int32;
+    MaxCellElevation = MIN_int32;
+    for (int32 i = 0; i < CellStore.Num(); i++)
+    {
+        MinCellElevation = FMath::Min(MinCellElevation, CellStore.GetElevation(i));
+        MaxCellElevation = FMath::Max(MaxCellElevation, CellStore.GetElevation(i));
+    }
+    if (CellStore.Num() == 0)
+    {
+        MinCellElevation = MaxCellElevation = 0;
+    }
+    bElevationBoundsDirty = false;
 }
 
-AHexCell* AHexGrid::GetCellByCoordinates(FHexCoordinates Coordinates)
+int32 AHexGrid::PickCell(const FVector& RayOrigin, const FVector& RayDirection, float MaxDistance, FVector* OutHitLocation) const
 {
-    int32 Z = Coordinates.Z;
-    if (Z < 0 || Z >= CellCountZ)
+    if (CellStore.Num() == 0)
     {
-        return nullptr;
+        return INDEX_NONE;
     }
+    UpdateElevationBounds();
+
+    // Walk in grid space with the ray parameterised over [0, 1].
+    const FTransform& Transform = GetActorTransform();
+    const FVector Origin = Transform.InverseTransformPosition(RayOrigin);
+    const FVector Delta = Transform.InverseTransformPosition(RayOrigin + RayDirection.GetSafeNormal() * MaxDistance) - Origin;
 
-    int32 X = Coordinates.X + Z / 2;
-    if (X < 0 || X >= CellCountX)
+    const float MinTop = MinCellElevation * HexMetrics::ElevationStep;
+    const float MaxTop = MaxCellElevation * HexMetrics::ElevationStep;
+
+    // Skip the part of the ray above the highest top, and stop below the lowest.
+    float TStart = 0.0f;
+    float TEnd = 1.0f;
+    if (FMath::Abs(Delta.Z) > KINDA_SMALL_NUMBER)
     {
-        return nullptr;
+        const float TAtMax = (MaxTop - Origin.Z) / Delta.Z;
+        const float TAtMin = (MinTop - Origin.Z) / Delta.Z;
+        TStart = FMath::Max(TStart, FMath::Min(TAtMax, TAtMin));
+        TEnd = FMath::Min(TEnd, FMath::Max(TAtMax, TAtMin));
+    }
+    else if (Origin.Z > MaxTop)
+    {
+        return INDEX_NONE;
+    }
+    if (TStart > TEnd)
+    {
+        return INDEX_NONE;
+    }
+
+    const FVector2D Origin2D(Origin.X, Origin.Y);
+    const FVector2D Delta2D(Delta.X, Delta.Y);
+
+    FHexAxial Cell = GetAxialCell(Origin2D + Delta2D * TStart);
+
+    // Unit edge normals: the midpoint of an edge lies InnerRadius from the centre.
+    FVector2D EdgeNormals[6];
+    float NormalDotDelta[6];
+    for (int32 d = 0; d < 6; d++)
+    {
+        const FVector Midpoint = (HexMetrics::Corners[d] + HexMetrics::Corners[(d + 1) % 6]) / (2.0f * HexMetrics::InnerRadius);
+        EdgeNormals[d] = FVector2D(Midpoint.X, Midpoint.Y);
+        NormalDotDelta[d] = FVector2D::DotProduct(EdgeNormals[d], Delta2D);
+    }
+
+    // A straight line crosses at most this many cells of the map.
+    const int32 MaxSteps = 2 * (CellStore.GetWidth() + CellStore.GetHeight()) + 4;
+
+    float TIn = TStart;
+    for (int32 Step = 0; Step < MaxSteps && TIn <= TEnd; Step++)
+    {
+        const FVector2D Center = GetAxialCenter(Cell);
+        const FVector2D Local = Origin2D - Center;
+
+        float TOut = MAX_flt;
+        int32 ExitDirection = INDEX_NONE;
+        for (int32 d = 0; d < 6; d++)
+        {
+            if (NormalDotDelta[d] > KINDA_SMALL_NUMBER)
+            {
+                const float T = (HexMetrics::InnerRadius - FVector2D::DotProduct(EdgeNormals[d], Local)) / NormalDotDelta[d];
+                if (T < TOut)
+                {
+                    TOut = T;
+                    ExitDirection = d;
+                }
+            }
+        }
+        TOut = FMath::Max(TOut, TIn);
+
+        const int32 CellIndex = CellStore.GetIndex(Cell);
+        if (CellIndex != INDEX_NONE)
+        {
+            const float Top = CellStore.GetElevation(CellIndex) * HexMetrics::ElevationStep;
+            const float ZIn = Origin.Z + Delta.Z * TIn;
+            const float ZOut = Origin.Z + Delta.Z * FMath::Min(TOut, 1.0f);
+
+            float THit = -1.0f;
+            if (ZIn <= Top)
+            {
+                // Entered through the side of the prism (or started inside it).
+                THit = TIn;
+            }
+            else if (ZOut <= Top)
+            {
+                THit = TIn + (ZIn - Top) / (ZIn - ZOut) * (FMath::Min(TOut, 1.0f) - TIn);
+            }
+
+            if (THit >= 0.0f)
+            {
+                if (OutHitLocation)
+                {
+                    *OutHitLocation = Transform.TransformPosition(Origin + Delta * THit);
+                }
+                return CellIndex;
+            }
+        }
+
+        if (ExitDirection == INDEX_NONE)
+        {
+            break;
+        }
+
+        Cell += HexMath::Directions[ExitDirection];
+        TIn = TOut;
     }
 
-    int32 Index = X + Z * CellCountX;
-    return Cells[Index];
+    return INDEX_NONE;
 }
 
-void AHexGrid::Refresh()
+
+int32 AHexGrid::GetChunkIndexForCell(int32 CellIndex) const
+{
+    if (!CellStore.IsValidIndex(CellIndex))
+    {
+        return INDEX_NONE;
+    }
+
+    int32 ChunkX = CellStore.GetOffsetX(CellIndex) / HexMetrics::ChunkSizeX;
+    int32 ChunkZ = CellStore.GetOffsetZ(CellIndex) / HexMetrics::ChunkSizeZ;
+    return ChunkX + ChunkZ * ChunkCountX;
+}
+
+AHexGridChunk* AHexGrid::GetChunkForCell(int32 CellIndex) const
 {
-    TriangulateCells();
+    int32 ChunkIndex = GetChunkIndexForCell(CellIndex);
+    return Chunks.IsValidIndex(ChunkIndex) ? Chunks[ChunkIndex] : nullptr;
 }
 
-void AHexGrid::CreateChunks()
+void AHexGrid::SetCellElevation(int32 CellIndex, int32 Elevation)
 {
-    if (!ChunkClass)
+    if (CellStore.IsValidIndex(CellIndex))
     {
-        UE_LOG(LogTemp, Error, TEXT("ChunkClass is not set! Cannot spawn HexGridChunk."));
-        return;
+        CellStore.SetElevation(CellIndex, Elevation);
+        bElevationBoundsDirty = true;
+        WriteBackCell(CellIndex);
+        MarkCellDataDirty(CellIndex);
+        RefreshCell(CellIndex);
     }
+}
 
-    Chunks.Empty();
-    Chunks.SetNum(ChunkCountX * ChunkCountZ);
+void AHexGrid::SetCellColor(int32 CellIndex, uint8 ColorIndex)
+{
+    if (CellStore.IsValidIndex(CellIndex))
+    {
+        CellStore.SetColorIndex(CellIndex, ColorIndex);
+        WriteBackCell(CellIndex);
+        MarkCellDataDirty(CellIndex);
+        // Cell instances bake their colour into custom data rather than reading
+        // the cell data texture, so they are refreshed either way.
+        if (!CellDataTexture || UsesCellInstances())
+        {
+            MarkCellDirty(CellIndex, true);
+        }
+    }
+}
+
+void AHexGrid::SetOutgoingRoad(int32 CellIndex, EHexDirection Direction)
+{
+    if (CellStore.IsValidIndex(CellIndex))
+    {
+        TArray<int32> ChangedCells;
+        CellStore.SetOutgoingRoad(CellIndex, Direction, ChangedCells);
+        RefreshCells(ChangedCells);
+    }
+}
+
+void AHexGrid::SetIncomingRoad(int32 CellIndex, EHexDirection Direction)
+{
+    if (CellStore.IsValidIndex(CellIndex))
+    {
+        // An incoming road is the neighbour's outgoing road pointing back at this cell.
+        const int32 Neighbor = CellStore.GetNeighbor(CellIndex, Direction);
+        if (Neighbor != INDEX_NONE)
+        {
+            SetOutgoingRoad(Neighbor, HexMetrics::Opposite(Direction));
+        }
+    }
+}
+
+void AHexGrid::RemoveOutgoingRoad(int32 CellIndex)
+{
+    if (CellStore.IsValidIndex(CellIndex))
+    {
+        TArray<int32> ChangedCells;
+        CellStore.RemoveOutgoingRoad(CellIndex, ChangedCells);
+        RefreshCells(ChangedCells);
+    }
+}
+
+void AHexGrid::RemoveIncomingRoad(int32 CellIndex)
+{
+    if (CellStore.IsValidIndex(CellIndex))
+    {
+        TArray<int32> ChangedCells;
+        CellStore.RemoveIncomingRoad(CellIndex, ChangedCells);
+        RefreshCells(ChangedCells);
+    }
+}
 
-    for (int32 Z = 0, I = 0; Z < ChunkCountZ; Z++)
+void AHexGrid::RemoveRoad(int32 CellIndex)
+{
+    if (CellStore.IsValidIndex(CellIndex))
+    {
+        TArray<int32> ChangedCells;
+        CellStore.RemoveRoad(CellIndex, ChangedCells);
+        RefreshCells(ChangedCells);
+    }
+}
+
+int32 AHexGrid::ApplyBrush(const FHexAxial& Center, int32 Radius, const FHexCellEdit& Edit)
+{
+    return ApplyBrushStroke(MakeArrayView(&Center, 1), Radius, Edit);
+}
+
+int32 AHexGrid::ApplyBrushStroke(TArrayView<const FHexAxial> Centers, int32 Radius, const FHexCellEdit& Edit)
+{
+    const int32 MapWidth = CellStore.GetWidth();
+    const int32 MapHeight = CellStore.GetHeight();
+    if (Centers.Num() == 0 || MapWidth == 0 || MapHeight == 0)
+    {
+        return 0;
+    }
+    Radius = FMath::Max(Radius, 0);
+
+    int32 FirstRow = MapHeight;
+    int32 LastRow = -1;
+    for (const FHexAxial& Center : Centers)
+    {
+        FirstRow = FMath::Min(FirstRow, Center.Z - Radius);
+        LastRow = FMath::Max(LastRow, Center.Z + Radius);
+    }
+    FirstRow = FMath::Max(FirstRow, 0);
+    LastRow = FMath::Min(LastRow, MapHeight - 1);
+    if (FirstRow > LastRow)
+    {
+        return 0;
+    }
+
+    // Offset X spans covered in each touched map row, from every stamp.
+    TArray<TArray<FIntPoint, TInlineAllocator<4>>> RowSpans;
+    RowSpans.SetNum(LastRow - FirstRow + 1);
+    for (const FHexAxial& Center : Centers)
     {
-        for (int32 X = 0; X < ChunkCountX; X++)
+        for (int32 DZ = -Radius; DZ <= Radius; DZ++)
         {
-            AHexGridChunk* Chunk = GetWorld()->SpawnActor<AHexGridChunk>(ChunkClass, FVector::ZeroVector, FRotator::ZeroRotator);
-            if (Chunk)
+            const int32 Z = Center.Z + DZ;
+            if (Z < FirstRow || Z > LastRow)
             {
-                Chunk->SetActorTransform(GetActorTransform());
-                Chunks[I++] = Chunk;
+                continue;
             }
-            else
+
+            const int32 RowShift = (Z - (Z & 1)) / 2;
+            const int32 MinX = FMath::Max(Center.X + HexMath::RangeRowBegin(DZ, Radius) + RowShift, 0);
+            const int32 MaxX = FMath::Min(Center.X + HexMath::RangeRowEnd(DZ, Radius) + RowShift, MapWidth - 1);
+            if (MinX <= MaxX)
+            {
+                RowSpans[Z - FirstRow].Add(FIntPoint(MinX, MaxX));
+            }
+        }
+    }
+
+    int32 ChangedCount = 0;
+    bool bElevationChanged = false;
+    for (int32 Z = FirstRow; Z <= LastRow; Z++)
+    {
+        TArray<FIntPoint, TInlineAllocator<4>>& Spans = RowSpans[Z - FirstRow];
+        if (Spans.Num() == 0)
+        {
+            continue;
+        }
+
+        Spans.Sort([](const FIntPoint& A, const FIntPoint& B) { return A.X < B.X; });
+        int32 NextX = 0;
+        for (const FIntPoint& Span : Spans)
+        {
+            for (int32 X = FMath::Max(Span.X, NextX); X <= Span.Y; X++)
             {
-                UE_LOG(LogTemp, Error, TEXT("Failed to spawn HexGridChunk at (%d, %d)"), X, Z);
+                if (ApplyCellEdit(CellStore.GetIndex(X, Z), Edit))
+                {
+                    ChangedCount++;
+                    bElevationChanged |= Edit.bApplyElevation;
+                }
             }
+            NextX = FMath::Max(NextX, Span.Y + 1);
+        }
+    }
+
+    if (bElevationChanged)
+    {
+        bElevationBoundsDirty = true;
+    }
+    return ChangedCount;
+}
+
+bool AHexGrid::ApplyCellEdit(int32 CellIndex, const FHexCellEdit& Edit)
+{
+    bool bGeometryChanged = false;
+    bool bColorChanged = false;
+
+    // The store keeps elevations as int8, so compare against what it would keep.
+    const int32 Elevation = FMath::Clamp<int32>(Edit.Elevation, MIN_int8, MAX_int8);
+    if (Edit.bApplyElevation && CellStore.GetElevation(CellIndex) != Elevation)
+    {
+        CellStore.SetElevation(CellIndex, Elevation);
+        bGeometryChanged = true;
+    }
+
+    if (Edit.bApplyColor && CellStore.GetColorIndex(CellIndex) != Edit.ColorIndex)
+    {
+        CellStore.SetColorIndex(CellIndex, Edit.ColorIndex);
+        bColorChanged = true;
+    }
+
+    if (!bGeometryChanged && !bColorChanged)
+    {
+        return false;
+    }
+
+    WriteBackCell(CellIndex);
+    MarkCellDataDirty(CellIndex);
+    if (bGeometryChanged)
+    {
+        MarkCellDirty(CellIndex);
+    }
+    else if (!CellDataTexture || UsesCellInstances())
+    {
+        MarkCellDirty(CellIndex, true);
+    }
+    return true;
+}
+
+void AHexGrid::RefreshCell(int32 CellIndex)
+{
+    MarkCellDirty(CellIndex);
+}
+
+void AHexGrid::RefreshCells(const TArray<int32>& CellIndices)
+{
+    for (int32 CellIndex : CellIndices)
+    {
+        WriteBackCell(CellIndex);
+        MarkCellDirty(CellIndex);
+    }
+}
+
+void AHexGrid::WriteBackCell(int32 CellIndex)
+{
+    if (MapMapping && CellStore.IsValidIndex(CellIndex))
+    {
+        MapMapping->WriteCell(CellStore, CellIndex);
+    }
+}
+
+void AHexGrid::MarkCellDirty(int32 CellIndex, bool bColorsOnly)
+{
+    if (!CellStore.IsValidIndex(CellIndex))
+    {
+        return;
+    }
+
+    MarkChunkDirty(GetChunkIndexForCell(CellIndex), bColorsOnly);
+    if (UsesCellInstances())
+    {
+        // Instances have no seams, so only the cell's own chunk changes.
+        return;
+    }
+
+    // Chunks triangulate the NE, E and SE connections and corners of their cells,
+    // so a cell's seams are also owned by its SW, W and NW neighbours.
+    static const EHexDirection SeamOwners[] = { EHexDirection::SW, EHexDirection::W, EHexDirection::NW };
+    for (EHexDirection Direction : SeamOwners)
+    {
+        int32 Neighbor = CellStore.GetNeighbor(CellIndex, Direction);
+        if (Neighbor != INDEX_NONE)
+        {
+            MarkChunkDirty(GetChunkIndexForCell(Neighbor), bColorsOnly);
+        }
+    }
+}
+
+void AHexGrid::MarkChunkDirty(int32 ChunkIndex, bool bColorsOnly)
+{
+    // Chunks outside the working set have nothing to rebuild; they are queued
+    // in full when they become resident again.
+    if (!Chunks.IsValidIndex(ChunkIndex) || !Chunks[ChunkIndex])
+    {
+        return;
+    }
+
+    if (DirtyChunkFlags[ChunkIndex])
+    {
+        if (!bColorsOnly)
+        {
+            ColorOnlyChunkFlags[ChunkIndex] = false;
         }
+        return;
+    }
+
+    DirtyChunkFlags[ChunkIndex] = true;
+    ColorOnlyChunkFlags[ChunkIndex] = bColorsOnly;
+    DirtyChunks.Add(ChunkIndex);
+}
+
+void AHexGrid::QueueChunkUpload(AHexGridChunk* Chunk)
+{
+    ChunkUploads.Add(Chunk);
+}
+
+void AHexGrid::FlushDirtyChunks()
+{
+    if (DirtyChunks.Num() == 0 && ChunkUploads.Num() == 0)
+    {
+        return;
+    }
+
+    const double Deadline = FPlatformTime::Seconds() + ChunkRebuildBudgetMs * 0.001;
+
+    // Finished builds first: they are what the player is waiting to see.
+    if (bHasView)
+    {
+        ChunkUploads.Sort([this](const TWeakObjectPtr<AHexGridChunk>& A, const TWeakObjectPtr<AHexGridChunk>& B)
+        {
+            const int32 IndexA = A.IsValid() ? A->GetChunkIndex() : INDEX_NONE;
+            const int32 IndexB = B.IsValid() ? B->GetChunkIndex() : INDEX_NONE;
+            if (IndexA == INDEX_NONE || IndexB == INDEX_NONE)
+            {
+                return IndexB == INDEX_NONE && IndexA != INDEX_NONE;
+            }
+            return CompareChunkPriority(IndexA, IndexB);
+        });
+    }
+    int32 Uploaded = 0;
+    while (Uploaded < ChunkUploads.Num() && (Uploaded == 0 || FPlatformTime::Seconds() < Deadline))
+    {
+        if (AHexGridChunk* Chunk = ChunkUploads[Uploaded].Get())
+        {
+            Chunk->ApplyReadyMesh();
+        }
+        Uploaded++;
+    }
+    ChunkUploads.RemoveAt(0, Uploaded, EAllowShrinking::No);
+
+    if (bHasView)
+    {
+        DirtyChunks.Sort([this](int32 A, int32 B) { return CompareChunkPriority(A, B); });
+    }
+    int32 Started = 0;
+    while (Started < DirtyChunks.Num() && (Started == 0 || FPlatformTime::Seconds() < Deadline))
+    {
+        const int32 ChunkIndex = DirtyChunks[Started++];
+        DirtyChunkFlags[ChunkIndex] = false;
+        if (AHexGridChunk* Chunk = Chunks[ChunkIndex])
+        {
+            if (ColorOnlyChunkFlags[ChunkIndex])
+            {
+                Chunk->RecolorCells();
+            }
+            else
+            {
+                Chunk->TriangulateCells();
+            }
+        }
+    }
+
+    DirtyChunks.RemoveAt(0, Started, EAllowShrinking::No);
+}
+
+AHexCell* AHexGrid::AcquireCellProxy(int32 CellIndex)
+{
+    if (!CellStore.IsValidIndex(CellIndex))
+    {
+        return nullptr;
+    }
+
+    if (AHexCell** Existing = CellProxies.Find(CellIndex))
+    {
+        return *Existing;
+    }
+
+    AHexCell* Cell = nullptr;
+    while (!Cell && CellProxyPool.Num() > 0)
+    {
+        Cell = CellProxyPool.Pop(EAllowShrinking::No);
+    }
+
+    if (!Cell)
+    {
+        if (!CellClass)
+        {
+            UE_LOG(LogTemp, Error, TEXT("CellClass is not set!"));
+            return nullptr;
+        }
+
+        Cell = GetWorld()->SpawnActor<AHexCell>(CellClass, FVector::ZeroVector, FRotator::ZeroRotator);
+        if (!Cell)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Failed to spawn HexCell proxy for cell %d. CellClass: %s"), CellIndex, *GetNameSafe(CellClass));
+            return nullptr;
+        }
+    }
+
+    Cell->BindToCell(this, CellIndex);
+    CellProxies.Add(CellIndex, Cell);
+    return Cell;
+}
+
+void AHexGrid::ReleaseCellProxy(AHexCell* Cell)
+{
+    if (!Cell || CellProxies.Remove(Cell->GetCellIndex()) == 0)
+    {
+        return;
+    }
+
+    Cell->Unbind();
+    CellProxyPool.Add(Cell);
+}
+
+void AHexGrid::RecordChunkMeshStats(int32 ChunkIndex, const FHexChunkMeshData& Mesh)
+{
+    if (!ChunkMeshStats.IsValidIndex(ChunkIndex))
+    {
+        return;
+    }
+
+    FChunkMeshStats& Stats = ChunkMeshStats[ChunkIndex];
+    Stats.RawVertices = Mesh.RawVertexCount;
+    Stats.RawIndices = Mesh.RawIndexCount;
+    Stats.Vertices = Mesh.NumVertices();
+    Stats.Indices = Mesh.Triangles.Num();
+
+    UE_LOG(LogTemp, Verbose, TEXT("Chunk %d mesh: %d -> %d vertices, %d -> %d indices"),
+        ChunkIndex, Stats.RawVertices, Stats.Vertices, Stats.RawIndices, Stats.Indices);
+}
+
+void AHexGrid::LogMeshStats() const
+{
+    FChunkMeshStats Total;
+    for (const FChunkMeshStats& Stats : ChunkMeshStats)
+    {
+        Total.RawVertices += Stats.RawVertices;
+        Total.RawIndices += Stats.RawIndices;
+        Total.Vertices += Stats.Vertices;
+        Total.Indices += Stats.Indices;
+    }
+
+    const float VertexRatio = Total.RawVertices > 0 ? float(Total.Vertices) / Total.RawVertices : 1.0f;
+    UE_LOG(LogTemp, Log, TEXT("HexGrid mesh (%s): %d -> %d vertices (%.1f%%), %d -> %d indices over %d chunks"),
+        bWeldChunkVertices ? TEXT("welded") : TEXT("unwelded"),
+        Total.RawVertices, Total.Vertices, VertexRatio * 100.0f,
+        Total.RawIndices, Total.Indices, ChunkMeshStats.Num());
+}
+
+FColor AHexGrid::MakeCellTexel(int32 CellIndex) const
+{
+    FColor Texel = CellStore.GetVertexColor(CellIndex);
+    Texel.A = static_cast<uint8>(CellStore.GetElevation(CellIndex) + 128);
+    return Texel;
+}
+
+void AHexGrid::CreateCellDataTexture()
+{
+    const int32 CellCount = CellStore.Num();
+    CellData.SetNumUninitialized(CellCount);
+    for (int32 i = 0; i < CellCount; i++)
+    {
+        CellData[i] = MakeCellTexel(i);
+    }
+    DirtyCellData.Reset();
+    DirtyCellDataFlags.Init(false, CellCount);
+
+    CellDataTexture = UTexture2D::CreateTransient(CellStore.GetWidth(), CellStore.GetHeight(), PF_B8G8R8A8);
+    if (!CellDataTexture)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to create the cell data texture (%d x %d)"), CellStore.GetWidth(), CellStore.GetHeight());
+        return;
+    }
+
+    CellDataTexture->Filter = TF_Nearest;
+    CellDataTexture->AddressX = TA_Clamp;
+    CellDataTexture->AddressY = TA_Clamp;
+    CellDataTexture->SRGB = true;
+    CellDataTexture->NeverStream = true;
+
+    FTexture2DMipMap& Mip = CellDataTexture->GetPlatformData()->Mips[0];
+    void* MipData = Mip.BulkData.Lock(LOCK_READ_WRITE);
+    FMemory::Memcpy(MipData, CellData.GetData(), CellCount * sizeof(FColor));
+    Mip.BulkData.Unlock();
+    CellDataTexture->UpdateResource();
+}
+
+void AHexGrid::ApplyCellData(UMaterialInstanceDynamic* Material) const
+{
+    if (!Material || !CellDataTexture)
+    {
+        return;
+    }
+
+    const float TexWidth = CellStore.GetWidth();
+    const float TexHeight = CellStore.GetHeight();
+    Material->SetTextureParameterValue(TEXT("CellData"), CellDataTexture);
+    Material->SetVectorParameterValue(TEXT("CellDataTexelSize"), FLinearColor(1.0f / TexWidth, 1.0f / TexHeight, TexWidth, TexHeight));
+}
+
+void AHexGrid::MarkCellDataDirty(int32 CellIndex)
+{
+    if (!CellDataTexture || !CellData.IsValidIndex(CellIndex))
+    {
+        return;
+    }
+
+    CellData[CellIndex] = MakeCellTexel(CellIndex);
+    if (!DirtyCellDataFlags[CellIndex])
+    {
+        DirtyCellDataFlags[CellIndex] = true;
+        DirtyCellData.Add(CellIndex);
+    }
+}
+
+void AHexGrid::FlushCellData()
+{
+    if (DirtyCellData.Num() == 0)
+    {
+        return;
+    }
+
+    // One region per run of dirty texels in a row. Each run becomes one row of
+    // the upload buffer, so only changed texels are copied.
+    DirtyCellData.Sort();
+    TArray<FUpdateTextureRegion2D> Runs;
+    int32 MaxRunLength = 0;
+    for (int32 i = 0; i < DirtyCellData.Num(); i++)
+    {
+        const int32 CellIndex = DirtyCellData[i];
+        DirtyCellDataFlags[CellIndex] = false;
+
+        const int32 X = CellStore.GetOffsetX(CellIndex);
+        const int32 Z = CellStore.GetOffsetZ(CellIndex);
+        if (i > 0 && CellIndex == DirtyCellData[i - 1] + 1 && X > 0)
+        {
+            Runs.Last().Width++;
+        }
+        else
+        {
+            Runs.Add(FUpdateTextureRegion2D(X, Z, 0, Runs.Num(), 1, 1));
+        }
+        MaxRunLength = FMath::Max<int32>(MaxRunLength, Runs.Last().Width);
+    }
+    DirtyCellData.Reset();
+
+    const uint32 SrcPitch = MaxRunLength * sizeof(FColor);
+    uint8* SrcData = static_cast<uint8*>(FMemory::Malloc(SrcPitch * Runs.Num()));
+    for (const FUpdateTextureRegion2D& Run : Runs)
+    {
+        FMemory::Memcpy(SrcData + Run.SrcY * SrcPitch, &CellData[CellStore.GetIndex(Run.DestX, Run.DestY)], Run.Width * sizeof(FColor));
+    }
+
+    FUpdateTextureRegion2D* Regions = new FUpdateTextureRegion2D[Runs.Num()];
+    FMemory::Memcpy(Regions, Runs.GetData(), Runs.Num() * sizeof(FUpdateTextureRegion2D));
+
+    CellDataTexture->UpdateTextureRegions(0, Runs.Num(), Regions, SrcPitch, sizeof(FColor), SrcData,
+        [](uint8* Data, const FUpdateTextureRegion2D* UpdatedRegions)
+        {
+            FMemory::Free(Data);
+            delete[] UpdatedRegions;
+        });
+}
+
+TArray<AHexCell*> AHexGrid::GetCells() const
+{
+    TArray<AHexCell*> Result;
+    CellProxies.GenerateValueArray(Result);
+    return Result;
+}
+
+void AHexGrid::Refresh()
+{
+    for (int32 ChunkIndex = 0; ChunkIndex < Chunks.Num(); ChunkIndex++)
+    {
+        if (Chunks[ChunkIndex])
+        {
+            MarkChunkDirty(ChunkIndex);
+        }
+    }
+}
+
+FString AHexGrid::GetMapPath(const FString& FileName)
+{
+    if (FPaths::IsRelative(FileName))
+    {
+        return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Maps"), FileName);
+    }
+    return FileName;
+}
+
+bool AHexGrid::SaveMap(const FString& FileName) const
+{
+    if (IsLoadingMap())
+    {
+        UE_LOG(LogTemp, Warning, TEXT("SaveMap: a map is still loading"));
+        return false;
+    }
+
+    // Saving truncates and rewrites the file, which would pull the pages out
+    // from under the mapping. The mapped file is kept current by every edit.
+    const FString Path = GetMapPath(FileName);
+    if (MapMapping && FPaths::IsSamePath(Path, MapMapping->GetPath()))
+    {
+        UE_LOG(LogTemp, Warning, TEXT("SaveMap: %s is the mapped map; it is already up to date"), *Path);
+        return false;
+    }
+    return HexMapFile::Save(Path, CellStore, ChunkCountX, ChunkCountZ, MapCompression);
+}
+
+bool AHexGrid::LoadMap(const FString& FileName)
+{
+    TUniquePtr<FHexMapReader> Reader = MakeUnique<FHexMapReader>();
+    if (!Reader->Open(GetMapPath(FileName)))
+    {
+        return false;
+    }
+
+    // A loaded map replaces the mapped one rather than being written into it.
+    CloseMappedMap();
+
+    const FHexMapHeader& Header = Reader->GetHeader();
+    if (Header.ChunkCountX != ChunkCountX || Header.ChunkCountZ != ChunkCountZ || Chunks.Num() != Header.NumBlocks())
+    {
+        const FIntRect WorkingSet = ChunkWorkingSet;
+        ResizeChunks(Header.ChunkCountX, Header.ChunkCountZ);
+        SetChunkWorkingSet(WorkingSet);
+    }
+
+    // Cells start blank; chunks are only queued once their blocks are decoded.
+    ClearDirtyChunks();
+    ApplyMapPalette(Header);
+    CreateCells();
+    if (bUseCellDataTexture && (!CellDataTexture || CellData.Num() != CellStore.Num()))
+    {
+        CreateCellDataTexture();
+    }
+
+    MapReader = MoveTemp(Reader);
+    NextMapBlock = 0;
+    NextMapChunk = 0;
+    UE_LOG(LogTemp, Log, TEXT("LoadMap: streaming %d x %d chunks from %s"), ChunkCountX, ChunkCountZ, *GetMapPath(FileName));
+    return true;
+}
+
+void AHexGrid::StreamMapBlocks()
+{
+    if (!MapReader)
+    {
+        return;
+    }
+
+    const int32 NumBlocks = MapReader->NumBlocks();
+    const int32 FirstBlock = NextMapBlock;
+    const int32 Count = FMath::Min(FMath::Max(MapLoadBlocksPerTick, 1), NumBlocks - FirstBlock);
+    const bool bSuccess = MapReader->ReadBlocks(FirstBlock, Count, CellStore);
+    NextMapBlock = bSuccess ? FirstBlock + Count : NumBlocks;
+    bElevationBoundsDirty = true;
+
+    if (CellDataTexture)
+    {
+        for (int32 Block = FirstBlock; Block < FirstBlock + Count; Block++)
+        {
+            const int32 MinX = (Block % ChunkCountX) * HexMetrics::ChunkSizeX;
+            const int32 MinZ = (Block / ChunkCountX) * HexMetrics::ChunkSizeZ;
+            for (int32 Z = MinZ; Z < MinZ + HexMetrics::ChunkSizeZ; Z++)
+            {
+                for (int32 X = MinX; X < MinX + HexMetrics::ChunkSizeX; X++)
+                {
+                    MarkCellDataDirty(CellStore.GetIndex(X, Z));
+                }
+            }
+        }
+    }
+
+    // A chunk also triangulates its seams with the chunks east of it and in the
+    // row above, so it waits until the block NE of it has been read as well.
+    const int32 ReadyChunks = NextMapBlock == NumBlocks ? NumBlocks : FMath::Max(NextMapBlock - ChunkCountX - 1, 0);
+    for (; NextMapChunk < ReadyChunks; NextMapChunk++)
+    {
+        MarkChunkDirty(NextMapChunk);
+    }
+
+    if (!bSuccess)
+    {
+        UE_LOG(LogTemp, Error, TEXT("LoadMap: failed to read blocks %d-%d, the rest of the map is left blank"),
+            FirstBlock, FirstBlock + Count - 1);
+    }
+    if (NextMapBlock == NumBlocks)
+    {
+        UE_LOG(LogTemp, Log, TEXT("LoadMap: finished, %d cells"), CellStore.Num());
+        MapReader.Reset();
+    }
+}
+
+bool AHexGrid::OpenMappedMap(const FString& FileName)
+{
+    TUniquePtr<FHexMapMapping> Mapping = MakeUnique<FHexMapMapping>();
+    if (!Mapping->Open(GetMapPath(FileName)))
+    {
+        return false;
+    }
+
+    MapReader.Reset();
+    const FHexMapHeader& Header = Mapping->GetHeader();
+    if (Header.ChunkCountX != ChunkCountX || Header.ChunkCountZ != ChunkCountZ || Chunks.Num() != Header.NumBlocks())
+    {
+        const FIntRect WorkingSet = ChunkWorkingSet;
+        ResizeChunks(Header.ChunkCountX, Header.ChunkCountZ);
+        SetChunkWorkingSet(WorkingSet);
+    }
+
+    // Records are decoded straight from the mapped pages; nothing is copied
+    // into an intermediate buffer first.
+    ApplyMapPalette(Header);
+    CreateCells();
+    ParallelFor(Mapping->NumBlocks(), [&](int32 Block)
+    {
+        Mapping->ReadBlock(Block, CellStore);
+    });
+    bElevationBoundsDirty = true;
+    MapMapping = MoveTemp(Mapping);
+
+    if (bUseCellDataTexture && (!CellDataTexture || CellData.Num() != CellStore.Num()))
+    {
+        CreateCellDataTexture();
+    }
+    else if (CellDataTexture)
+    {
+        for (int32 CellIndex = 0; CellIndex < CellStore.Num(); CellIndex++)
+        {
+            MarkCellDataDirty(CellIndex);
+        }
+    }
+    Refresh();
+
+    UE_LOG(LogTemp, Log, TEXT("OpenMappedMap: mapped %d x %d chunks from %s"), ChunkCountX, ChunkCountZ, *GetMapPath(FileName));
+    return true;
+}
+
+void AHexGrid::CloseMappedMap()
+{
+    MapMapping.Reset();
+}
+
+void AHexGrid::ApplyMapPalette(const FHexMapHeader& Header)
+{
+    // Version 1 maps carry no palette; their colours are matched against ours.
+    if (Header.Palette.Num() > 0)
+    {
+        CellPalette = Header.Palette;
+        UpdateCellPalette();
+        OnCellPaletteChanged.Broadcast();
+    }
+}
+
+void AHexGrid::ClearDirtyChunks()
+{
+    for (int32 ChunkIndex : DirtyChunks)
+    {
+        DirtyChunkFlags[ChunkIndex] = false;
+    }
+    DirtyChunks.Reset();
+}
+
+void AHexGrid::DestroyChunks()
+{
+    for (AHexGridChunk* Chunk : Chunks)
+    {
+        if (Chunk)
+        {
+            Chunk->Destroy();
+        }
+    }
+    // Pooled chunks may hold material instances bound to the old cell data texture.
+    for (AHexGridChunk* Chunk : ChunkPool)
+    {
+        if (Chunk)
+        {
+            Chunk->Destroy();
+        }
+    }
+    Chunks.Empty();
+    ChunkPool.Empty();
+    DirtyChunks.Reset();
+    ChunkWorkingSet = FIntRect();
+}
+
+void AHexGrid::ResizeChunks(int32 InChunkCountX, int32 InChunkCountZ)
+{
+    DestroyChunks();
+    ChunkCountX = InChunkCountX;
+    ChunkCountZ = InChunkCountZ;
+    CellCountX = ChunkCountX * HexMetrics::ChunkSizeX;
+    CellCountZ = ChunkCountZ * HexMetrics::ChunkSizeZ;
+    Width = CellCountX;
+    Height = CellCountZ;
+
+    Chunks.SetNum(ChunkCountX * ChunkCountZ);
+    DirtyChunkFlags.Init(false, Chunks.Num());
+    ColorOnlyChunkFlags.Init(false, Chunks.Num());
+    ChunkMeshStats.Init(FChunkMeshStats(), Chunks.Num());
+}
+
+void AHexGrid::CreateChunks()
+{
+    // Streamed grids start empty; the first tick fills in the chunks around the view.
+    ResizeChunks(ChunkCountX, ChunkCountZ);
+    if (!bStreamChunks)
+    {
+        SetChunkWorkingSet(FIntRect(0, 0, ChunkCountX, ChunkCountZ));
+    }
+}
+
+void AHexGrid::UpdateView()
+{
+    APlayerController* PC = GetWorld()->GetFirstPlayerController();
+    bHasView = PC && PC->PlayerCameraManager;
+    if (!bHasView)
+    {
+        return;
+    }
+
+    const FMinimalViewInfo& View = PC->PlayerCameraManager->GetCameraCacheView();
+    const FTransform& Transform = GetActorTransform();
+    const FVector Eye = Transform.InverseTransformPosition(View.Location);
+    const FVector Forward = Transform.InverseTransformVectorNoScale(View.Rotation.Vector());
+
+    // Centre of the view on the grid plane.
+    FVector Center = Eye;
+    if (Forward.Z < -KINDA_SMALL_NUMBER)
+    {
+        Center = Eye + Forward * (-Eye.Z / Forward.Z);
+    }
+
+    float Radius = PerspectiveStreamingRadius;
+    UpdateChunkDetail(View.ProjectionMode == ECameraProjectionMode::Orthographic ? View.OrthoWidth : 0.0f);
+    if (View.ProjectionMode == ECameraProjectionMode::Orthographic)
+    {
+        // The view's height is stretched along the ground by the camera's tilt.
+        const float HalfWidth = View.OrthoWidth * 0.5f;
+        const float HalfHeight = HalfWidth / FMath::Max(View.AspectRatio, 0.1f) / FMath::Max(FMath::Abs(Forward.Z), 0.1f);
+        Radius = FMath::Sqrt(HalfWidth * HalfWidth + HalfHeight * HalfHeight);
+    }
+    ViewCenter = FVector2D(Center.X, Center.Y);
+    ViewRadius = Radius / FMath::Max(Transform.GetMinimumAxisScale(), KINDA_SMALL_NUMBER);
+}
+
+void AHexGrid::UpdateChunkDetail(float OrthoWidth)
+{
+    // A band around the threshold keeps small zoom changes from flipping every chunk.
+    const EHexChunkDetail LowDetail = bPerturbLowDetail ? EHexChunkDetail::Low : EHexChunkDetail::LowUnperturbed;
+    EHexChunkDetail Detail = ChunkDetail;
+    if (LowDetailOrthoWidth <= 0.0f || OrthoWidth < LowDetailOrthoWidth * 0.9f)
+    {
+        Detail = EHexChunkDetail::Full;
+    }
+    else if (OrthoWidth > LowDetailOrthoWidth * 1.1f || Detail != EHexChunkDetail::Full)
+    {
+        Detail = LowDetail;
+    }
+
+    if (Detail != ChunkDetail)
+    {
+        UE_LOG(LogTemp, Log, TEXT("HexGrid: ortho width %.0f, switching chunks to detail level %d"), OrthoWidth, static_cast<int32>(Detail));
+        ChunkDetail = Detail;
+        Refresh();
+    }
+}
+
+void AHexGrid::UpdateChunkStreaming()
+{
+    if (!bStreamChunks || !bHasView || Chunks.Num() == 0)
+    {
+        return;
+    }
+
+    const float ChunkWidth = HexMetrics::ChunkSizeX * HexMetrics::InnerRadius * 2.0f;
+    const float ChunkDepth = HexMetrics::ChunkSizeZ * HexMetrics::OuterRadius * 1.5f;
+    SetChunkWorkingSet(FIntRect(
+        FMath::FloorToInt((ViewCenter.X - ViewRadius) / ChunkWidth) - ChunkStreamingMargin,
+        FMath::FloorToInt((ViewCenter.Y - ViewRadius) / ChunkDepth) - ChunkStreamingMargin,
+        FMath::FloorToInt((ViewCenter.X + ViewRadius) / ChunkWidth) + 1 + ChunkStreamingMargin,
+        FMath::FloorToInt((ViewCenter.Y + ViewRadius) / ChunkDepth) + 1 + ChunkStreamingMargin));
+}
+
+float AHexGrid::GetChunkViewDistanceSquared(int32 ChunkIndex) const
+{
+    const float ChunkWidth = HexMetrics::ChunkSizeX * HexMetrics::InnerRadius * 2.0f;
+    const float ChunkDepth = HexMetrics::ChunkSizeZ * HexMetrics::OuterRadius * 1.5f;
+    const FVector2D ChunkCenter(
+        (ChunkIndex % ChunkCountX + 0.5f) * ChunkWidth,
+        (ChunkIndex / ChunkCountX + 0.5f) * ChunkDepth);
+    return FVector2D::DistSquared(ChunkCenter, ViewCenter);
+}
+
+bool AHexGrid::IsChunkInView(int32 ChunkIndex) const
+{
+    // The view circle against the circle around the chunk.
+    const float ChunkWidth = HexMetrics::ChunkSizeX * HexMetrics::InnerRadius * 2.0f;
+    const float ChunkDepth = HexMetrics::ChunkSizeZ * HexMetrics::OuterRadius * 1.5f;
+    const float Reach = ViewRadius + 0.5f * FMath::Sqrt(ChunkWidth * ChunkWidth + ChunkDepth * ChunkDepth);
+    return GetChunkViewDistanceSquared(ChunkIndex) <= Reach * Reach;
+}
+
+bool AHexGrid::CompareChunkPriority(int32 A, int32 B) const
+{
+    const bool bVisibleA = IsChunkInView(A);
+    const bool bVisibleB = IsChunkInView(B);
+    if (bVisibleA != bVisibleB)
+    {
+        return bVisibleA;
+    }
+    return GetChunkViewDistanceSquared(A) < GetChunkViewDistanceSquared(B);
+}
+
+void AHexGrid::SetChunkWorkingSet(const FIntRect& ChunkRect)
+{
+    const FIntRect NewSet(
+        FMath::Max(ChunkRect.Min.X, 0), FMath::Max(ChunkRect.Min.Y, 0),
+        FMath::Min(ChunkRect.Max.X, ChunkCountX), FMath::Min(ChunkRect.Max.Y, ChunkCountZ));
+    if (NewSet == ChunkWorkingSet)
+    {
+        return;
+    }
+
+    // Only the old and new rectangles can change, so the rest of the map is never visited.
+    for (int32 Z = ChunkWorkingSet.Min.Y; Z < ChunkWorkingSet.Max.Y; Z++)
+    {
+        for (int32 X = ChunkWorkingSet.Min.X; X < ChunkWorkingSet.Max.X; X++)
+        {
+            const int32 ChunkIndex = X + Z * ChunkCountX;
+            if (!NewSet.Contains(FIntPoint(X, Z)))
+            {
+                ReleaseChunk(ChunkIndex);
+            }
+        }
+    }
+
+    for (int32 Z = NewSet.Min.Y; Z < NewSet.Max.Y; Z++)
+    {
+        for (int32 X = NewSet.Min.X; X < NewSet.Max.X; X++)
+        {
+            const int32 ChunkIndex = X + Z * ChunkCountX;
+            if (!Chunks[ChunkIndex] && SpawnChunk(ChunkIndex))
+            {
+                MarkChunkDirty(ChunkIndex);
+            }
+        }
+    }
+
+    ChunkWorkingSet = NewSet;
+}
+
+AHexGridChunk* AHexGrid::SpawnChunk(int32 ChunkIndex)
+{
+    if (!ChunkClass)
+    {
+        UE_LOG(LogTemp, Error, TEXT("ChunkClass is not set! Cannot spawn HexGridChunk."));
+        return nullptr;
+    }
+
+    const int32 ChunkX = ChunkIndex % ChunkCountX;
+    const int32 ChunkZ = ChunkIndex / ChunkCountX;
+    AHexGridChunk* Chunk = nullptr;
+    while (!Chunk && ChunkPool.Num() > 0)
+    {
+        Chunk = ChunkPool.Pop(EAllowShrinking::No);
+    }
+
+    if (Chunk)
+    {
+        Chunk->Activate();
+    }
+    else
+    {
+        Chunk = GetWorld()->SpawnActor<AHexGridChunk>(ChunkClass, FVector::ZeroVector, FRotator::ZeroRotator);
+        if (!Chunk)
+        {
+            UE_LOG(LogTemp, Error, TEXT("Failed to spawn HexGridChunk at (%d, %d)"), ChunkX, ChunkZ);
+            return nullptr;
+        }
+    }
+
+    Chunk->SetActorTransform(GetActorTransform());
+    Chunk->SetGrid(this, ChunkIndex);
+    Chunks[ChunkIndex] = Chunk;
+
+    // Cells only register with resident chunks, so a chunk entering the working
+    // set picks up its cells here. The store may still be empty at this point.
+    for (int32 LocalZ = 0; LocalZ < HexMetrics::ChunkSizeZ; LocalZ++)
+    {
+        for (int32 LocalX = 0; LocalX < HexMetrics::ChunkSizeX; LocalX++)
+        {
+            Chunk->AddCell(LocalX + LocalZ * HexMetrics::ChunkSizeX, CellStore.GetIndex(
+                ChunkX * HexMetrics::ChunkSizeX + LocalX, ChunkZ * HexMetrics::ChunkSizeZ + LocalZ));
+        }
+    }
+    return Chunk;
+}
+
+void AHexGrid::ReleaseChunk(int32 ChunkIndex)
+{
+    if (!Chunks.IsValidIndex(ChunkIndex) || !Chunks[ChunkIndex])
+    {
+        return;
+    }
+
+    Chunks[ChunkIndex]->ReleaseToPool();
+    ChunkPool.Add(Chunks[ChunkIndex]);
+    Chunks[ChunkIndex] = nullptr;
+    ChunkMeshStats[ChunkIndex] = FChunkMeshStats();
+
+    // A queued rebuild is redone when the chunk comes back into the working set.
+    if (DirtyChunkFlags[ChunkIndex])
+    {
+        DirtyChunkFlags[ChunkIndex] = false;
+        DirtyChunks.Remove(ChunkIndex);
     }
 }
 
-void AHexGrid::AddCellToChunk(int32 X, int32 Z, AHexCell* Cell)
+void AHexGrid::AddCellToChunk(int32 X, int32 Z, int32 CellIndex)
 {
     int32 ChunkX = X / HexMetrics::ChunkSizeX;
     int32 ChunkZ = Z / HexMetrics::ChunkSizeZ;
     int32 ChunkIndex = ChunkX + ChunkZ * ChunkCountX;
 
-    if (Chunks.IsValidIndex(ChunkIndex))
+    if (Chunks.IsValidIndex(ChunkIndex) && Chunks[ChunkIndex])
     {
         AHexGridChunk* Chunk = Chunks[ChunkIndex];
         int32 LocalX = X - ChunkX * HexMetrics::ChunkSizeX;
         int32 LocalZ = Z - ChunkZ * HexMetrics::ChunkSizeZ;
         int32 LocalIndex = LocalX + LocalZ * HexMetrics::ChunkSizeX;
-        Chunk->AddCell(LocalIndex, Cell);
+        Chunk->AddCell(LocalIndex, CellIndex);
     }
 }
\ No newline at end of file
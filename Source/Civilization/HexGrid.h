@@ -4,11 +4,53 @@
 #include "GameFramework/Actor.h"
 #include "HexMetrics.h"
 #include "HexDirection.h"
+#include "HexCellStore.h"
+#include "HexMapFile.h"
 #include "HexGrid.generated.h"
 
 class AHexCell;
 class AHexGridChunk;
+class UMaterialInstanceDynamic;
+class UStaticMesh;
 struct FHexCoordinates;
+struct FHexChunkMeshData;
+enum class EHexChunkDetail : uint8;
+
+// One edit applied to many cells. Each layer is only written when its flag is
+// set; new per-cell layers get a flag and a value here.
+struct FHexCellEdit
+{
+    bool bApplyColor = false;
+    uint8 ColorIndex = 0;
+
+    bool bApplyElevation = false;
+    int32 Elevation = 0;
+};
+
+UENUM(BlueprintType)
+enum class EHexChunkCollision : uint8
+{
+    // No physics collision; cells are picked with AHexGrid::PickCell.
+    None,
+    // The render mesh itself, terraces and perturbation included.
+    Full,
+    // One flat hex prism per cell at its elevation, as simple convex shapes.
+    Simplified
+};
+
+UENUM(BlueprintType)
+enum class EHexChunkRenderMode : uint8
+{
+    // Procedural chunk meshes with terraces and blended seams.
+    Triangulated,
+    // One instance of CellInstanceMesh per cell, coloured through per-instance
+    // custom data (R, G, B, elevation). Edits only touch instance data.
+    Instanced,
+    // Triangulated at full detail, instanced whenever chunks would be low detail.
+    InstancedWhenZoomedOut
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FHexCellPaletteChangedSignature);
 
 UCLASS()
 class CIVILIZATION_API AHexGrid : public AActor
@@ -19,27 +61,225 @@ public:
     AHexGrid();
 
     virtual void BeginPlay() override;
+    virtual void Tick(float DeltaTime) override;
 
     void CreateChunks();
     void CreateCells();
-    void AddCellToChunk(int32 X, int32 Z, AHexCell* Cell);
+    void AddCellToChunk(int32 X, int32 Z, int32 CellIndex);
     void TriangulateCells();
 
-    AHexCell* GetCellByPosition(FVector Position);
-    AHexCell* GetCellByCoordinates(FHexCoordinates Coordinates);
+    const FHexCellStore& GetCellStore() const { return CellStore; }
+
+    int32 GetCellIndexByPosition(FVector Position) const;
+
+    // Finds the first cell a world-space ray hits, walking the ray cell by cell
+    // across the map and testing it against each cell's flat-topped prism. Needs
+    // no chunk collision. Returns INDEX_NONE if nothing is hit within MaxDistance.
+    int32 PickCell(const FVector& RayOrigin, const FVector& RayDirection, float MaxDistance, FVector* OutHitLocation = nullptr) const;
+
+    int32 GetCellIndexByCoordinates(const FHexCoordinates& Coordinates) const { return CellStore.GetIndex(Coordinates); }
+    int32 GetChunkIndexForCell(int32 CellIndex) const;
+    AHexGridChunk* GetChunkForCell(int32 CellIndex) const;
+
+    // Cell edits write through the cell store and mark the affected chunks dirty.
+    void SetCellElevation(int32 CellIndex, int32 Elevation);
+    void SetCellColor(int32 CellIndex, uint8 ColorIndex);
+    void SetOutgoingRoad(int32 CellIndex, EHexDirection Direction);
+    void SetIncomingRoad(int32 CellIndex, EHexDirection Direction);
+    void RemoveOutgoingRoad(int32 CellIndex);
+    void RemoveIncomingRoad(int32 CellIndex);
+    void RemoveRoad(int32 CellIndex);
+    void RefreshCell(int32 CellIndex);
+
+    // Applies Edit to every map cell within Radius of Center, writing the cell
+    // store directly. Cells that end up unchanged are skipped; the rest mark
+    // their chunks dirty, so each chunk is rebuilt once. Returns the cells changed.
+    int32 ApplyBrush(const FHexAxial& Center, int32 Radius, const FHexCellEdit& Edit);
+
+    // Same as ApplyBrush for several stamps at once, e.g. a frame of a drag
+    // stroke. The stamps are merged into one span per map row first, so cells
+    // under overlapping stamps are visited once.
+    int32 ApplyBrushStroke(TArrayView<const FHexAxial> Centers, int32 Radius, const FHexCellEdit& Edit);
+
+    // Dirty chunks are collected during the frame and each rebuilt once in Tick.
+    // Colour-only marks are upgraded if the chunk also gets a geometry mark.
+    void MarkCellDirty(int32 CellIndex, bool bColorsOnly = false);
+    void MarkChunkDirty(int32 ChunkIndex, bool bColorsOnly = false);
+
+    // Uploads finished chunk meshes and starts queued rebuilds, visible chunks
+    // first and then by distance from the view, until ChunkRebuildBudgetMs is
+    // spent. Whatever is left waits for the next tick.
+    void FlushDirtyChunks();
+
+    // A chunk whose build has finished asks to have its mesh uploaded.
+    void QueueChunkUpload(AHexGridChunk* Chunk);
+
+    // Game-thread time per tick for chunk rebuilds and mesh uploads. At least
+    // one of each is done every tick, so the queues always drain.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid", meta = (ClampMin = "0"))
+    float ChunkRebuildBudgetMs = 4.0f;
+
+    // Terraces on each slope between adjacent elevations. Each supported count
+    // has its own triangulation kernel (see FHexChunkTriangulator).
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid", meta = (ClampMin = "1", ClampMax = "4"))
+    int32 TerracesPerSlope = HexMetrics::TerracesPerSlope;
+
+    // Changes TerracesPerSlope and rebuilds the resident chunks.
+    UFUNCTION(BlueprintCallable, Category = "HexGrid")
+    void SetTerracesPerSlope(int32 Count);
+
+    // Colours cells are painted with; cells store an index into this list (see
+    // FHexCellPalette). At most FHexCellPalette::MaxColors entries are used, and
+    // an empty palette paints every cell white.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid")
+    TArray<FLinearColor> CellPalette;
+
+    // Replaces CellPalette and redraws every cell with the new colours. Cells
+    // keep their indices. Ignored while a map is mapped (see OpenMappedMap).
+    UFUNCTION(BlueprintCallable, Category = "HexGrid")
+    void SetCellPalette(const TArray<FLinearColor>& Colors);
+
+    // Broadcast after CellPalette is replaced, by SetCellPalette or by a map
+    // bringing its own palette.
+    UPROPERTY(BlueprintAssignable, Category = "HexGrid")
+    FHexCellPaletteChangedSignature OnCellPaletteChanged;
+
+    // Ortho width above which chunks are rebuilt at low detail (see
+    // EHexChunkDetail). Chunks switch as they come up in the rebuild queue,
+    // visible ones first. Zero keeps full detail at every zoom.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid|LOD", meta = (ClampMin = "0"))
+    float LowDetailOrthoWidth = 300.0f;
+
+    // Whether low-detail chunks keep the noise perturbation.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid|LOD")
+    bool bPerturbLowDetail = true;
+
+    // Detail level new chunk builds use, chosen from the current zoom.
+    EHexChunkDetail GetChunkDetail() const { return ChunkDetail; }
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid|Instancing")
+    EHexChunkRenderMode ChunkRenderMode = EHexChunkRenderMode::Triangulated;
+
+    // Mesh drawn per cell in the instanced modes, placed at the cell centre and
+    // elevation with CellInstanceScale. Its material reads PerInstanceCustomData 0-3.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid|Instancing")
+    UStaticMesh* CellInstanceMesh;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid|Instancing")
+    FVector CellInstanceScale = FVector::OneVector;
+
+    // Switches the render mode and rebuilds the resident chunks in the new one.
+    UFUNCTION(BlueprintCallable, Category = "HexGrid|Instancing")
+    void SetChunkRenderMode(EHexChunkRenderMode Mode);
+
+    // Whether chunks should currently draw cell instances instead of a mesh.
+    bool UsesCellInstances() const;
+
+    // Cell actors are pooled proxies, spawned only when something needs an actor.
+    // Lookups return cell indices; a proxy exists only between these two calls.
+    AHexCell* AcquireCellProxy(int32 CellIndex);
+    void ReleaseCellProxy(AHexCell* Cell);
 
     UFUNCTION(BlueprintCallable, Category = "HexGrid")
     void Refresh();
 
+    // Writes every cell to a binary map file. Relative names go under Saved/Maps.
+    // Fails for the file open with OpenMappedMap, which never needs saving.
+    UFUNCTION(BlueprintCallable, Category = "HexGrid")
+    bool SaveMap(const FString& FileName) const;
+
+    // Starts streaming a map file into the grid, resizing it to the map first.
+    // Blocks are decoded straight into the cell store a run per tick, and each
+    // chunk is queued for triangulation as soon as the cells it reads are in.
+    UFUNCTION(BlueprintCallable, Category = "HexGrid")
+    bool LoadMap(const FString& FileName);
+
+    bool IsLoadingMap() const { return MapReader.IsValid(); }
+
+    // Uses an uncompressed map file as the grid's backing store. The file is
+    // mapped rather than read, and every cell edit is written back through the
+    // mapping, so the file stays current without ever being saved. The palette
+    // is the file's and cannot be changed until the map is closed.
+    UFUNCTION(BlueprintCallable, Category = "HexGrid")
+    bool OpenMappedMap(const FString& FileName);
+
+    UFUNCTION(BlueprintCallable, Category = "HexGrid")
+    void CloseMappedMap();
+
+    bool IsMapMapped() const { return MapMapping.IsValid(); }
+
+    // Chunks inside ChunkRect (chunk coordinates, max exclusive) hold an actor
+    // and a mesh; chunks that leave it release theirs. Chunks entering the set
+    // are queued for triangulation.
+    void SetChunkWorkingSet(const FIntRect& ChunkRect);
+    const FIntRect& GetChunkWorkingSet() const { return ChunkWorkingSet; }
+
+    // Keep only the chunks around the player's view in the working set, updated
+    // every tick from the camera position and ortho width. Released chunk actors
+    // are pooled and rebound rather than destroyed. When off, every chunk stays resident.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid|Streaming")
+    bool bStreamChunks = true;
+
+    // Chunks kept resident beyond the edge of the view on every side.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid|Streaming", meta = (ClampMin = "0"))
+    int32 ChunkStreamingMargin = 1;
+
+    // Ground radius streamed around a perspective camera, which has no ortho width.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid|Streaming")
+    float PerspectiveStreamingRadius = 200.0f;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid")
+    EHexMapCompression MapCompression = EHexMapCompression::LZ4;
+
+    // Chunk blocks read and decoded per tick while a map is loading.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid", meta = (ClampMin = "1"))
+    int32 MapLoadBlocksPerTick = 4096;
+
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid")
     TSubclassOf<AHexCell> CellClass;
 
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid")
     TSubclassOf<AHexGridChunk> ChunkClass;
 
+    // Physics collision for chunk meshes. Cell picking does not need it.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid")
+    EHexChunkCollision ChunkCollision = EHexChunkCollision::None;
+
+    // Cook chunk collision off the game thread; the old collision stays active until it is done.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid")
+    bool bAsyncCollisionCooking = true;
+
+    // Triangulate chunks on task-graph workers instead of the game thread.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid")
+    bool bAsyncTriangulation = true;
+
+    // Share vertices between triangles and emit a real index buffer.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid")
+    bool bWeldChunkVertices = false;
+
+    // Vertex and index counts of every chunk, before and after welding.
+    void RecordChunkMeshStats(int32 ChunkIndex, const FHexChunkMeshData& Mesh);
+
+    UFUNCTION(BlueprintCallable, Category = "HexGrid")
+    void LogMeshStats() const;
+
+    // Shade cells from a grid-wide texture with one texel per cell (RGB colour,
+    // A elevation + 128) instead of baked vertex colours. Chunk meshes then carry
+    // cell indices in UV1/UV2 and blend weights in the vertex colour, and colour
+    // edits only touch the texture. The chunk material must read CellData.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid")
+    bool bUseCellDataTexture = false;
+
+    UTexture2D* GetCellDataTexture() const { return CellDataTexture; }
+    void ApplyCellData(UMaterialInstanceDynamic* Material) const;
+    void MarkCellDataDirty(int32 CellIndex);
+
     //  Getter
     UFUNCTION(BlueprintCallable, Category = "HexGrid")
-    TArray<AHexCell*> GetCells() const { return Cells; }
+    TArray<AHexCell*> GetCells() const;
+
+    UFUNCTION(BlueprintCallable, Category = "HexGrid")
+    int32 GetCellCount() const { return CellStore.Num(); }
 protected:
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid")
     int32 ChunkCountX = 4;
@@ -50,14 +290,101 @@ protected:
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexGrid")
     UTexture2D* NoiseSource;
 
+    FHexCellStore CellStore;
+
+    // Proxies currently bound to a cell, keyed by cell index.
     UPROPERTY()
-    TArray<AHexCell*> Cells;
+    TMap<int32, AHexCell*> CellProxies;
+
+    // Released proxies, hidden and ready to be rebound.
+    UPROPERTY()
+    TArray<AHexCell*> CellProxyPool;
 
     UPROPERTY()
     TArray<AHexGridChunk*> Chunks;
 
+    // Released chunk actors, hidden and ready to be bound to another slot.
+    UPROPERTY()
+    TArray<AHexGridChunk*> ChunkPool;
+
+    TArray<int32> DirtyChunks;
+    TBitArray<> DirtyChunkFlags;
+    TBitArray<> ColorOnlyChunkFlags;
+    TArray<TWeakObjectPtr<AHexGridChunk>> ChunkUploads;
+
+    // Player view projected onto the grid, in grid space, from the last tick.
+    bool bHasView = false;
+    FVector2D ViewCenter = FVector2D::ZeroVector;
+    float ViewRadius = 0.0f;
+
+    EHexChunkDetail ChunkDetail{};
+    void UpdateChunkDetail(float OrthoWidth);
+
+    bool IsChunkInView(int32 ChunkIndex) const;
+    float GetChunkViewDistanceSquared(int32 ChunkIndex) const;
+    bool CompareChunkPriority(int32 A, int32 B) const;
+
+    UPROPERTY()
+    UTexture2D* CellDataTexture = nullptr;
+
+    // CPU copy of CellDataTexture; dirty texels are uploaded once per frame.
+    TArray<FColor> CellData;
+    TArray<int32> DirtyCellData;
+    TBitArray<> DirtyCellDataFlags;
+
+    // Lowest and highest cell elevation, bounding the height range PickCell walks.
+    mutable int32 MinCellElevation = 0;
+    mutable int32 MaxCellElevation = 0;
+    mutable bool bElevationBoundsDirty = true;
+    void UpdateElevationBounds() const;
+
+    // Builds the palette, and its blend tables for TerracesPerSlope, from CellPalette.
+    void UpdateCellPalette();
+
+    void CreateCellDataTexture();
+    void FlushCellData();
+    FColor MakeCellTexel(int32 CellIndex) const;
+
+    struct FChunkMeshStats
+    {
+        int32 RawVertices = 0;
+        int32 RawIndices = 0;
+        int32 Vertices = 0;
+        int32 Indices = 0;
+    };
+    TArray<FChunkMeshStats> ChunkMeshStats;
+
     int32 CellCountX;
     int32 CellCountZ;
     int32 Width;
     int32 Height;
+
+    void RefreshCells(const TArray<int32>& CellIndices);
+
+    // Map being streamed in, the next block to read and the next chunk to queue.
+    TUniquePtr<FHexMapReader> MapReader;
+    int32 NextMapBlock = 0;
+    int32 NextMapChunk = 0;
+
+    TUniquePtr<FHexMapMapping> MapMapping;
+
+    // Chunks with an actor; every other entry of Chunks is null.
+    FIntRect ChunkWorkingSet;
+
+    void StreamMapBlocks();
+    void WriteBackCell(int32 CellIndex);
+    void ResizeChunks(int32 InChunkCountX, int32 InChunkCountZ);
+    AHexGridChunk* SpawnChunk(int32 ChunkIndex);
+    void ReleaseChunk(int32 ChunkIndex);
+    void DestroyChunks();
+    void UpdateView();
+    void UpdateChunkStreaming();
+    void ClearDirtyChunks();
+    static FString GetMapPath(const FString& FileName);
+
+    // Replaces CellPalette with the one saved in a map, before its cells are read.
+    void ApplyMapPalette(const FHexMapHeader& Header);
+
+    // Writes Edit to one cell and marks what it changed. Returns false if nothing changed.
+    bool ApplyCellEdit(int32 CellIndex, const FHexCellEdit& Edit);
 };
\ No newline at end of file
@@ -1,19 +1,38 @@
 #include "HexGridChunk.h"
-#include "HexCell.h"
+#include "HexGrid.h"
+#include "HexCellStore.h"
+#include "HexChunkTriangulator.h"
+#include "HexPerturbCache.h"
+#include "Async/Async.h"
 #include "HexMetrics.h"
-#include "Components/DecalComponent.h"
-#include "ProceduralMeshComponent.h"
+#include "Materials/MaterialInstanceDynamic.h"
+#include "HexChunkMeshComponent.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
 
-#define LOG_TO_FILE(Category, Verbosity, Format, ...) \
-    UE_LOG(Category, Verbosity, Format, ##__VA_ARGS__); \
-    GLog->Logf(ELogVerbosity::Verbosity, TEXT("%s"), *FString::Printf(Format, ##__VA_ARGS__));
+namespace
+{
+    // Adds the road overlay to a finished full build, if any of its cells has a road.
+    void TriangulateRoads(const FHexCellStore& Snapshot, const TArray<int32>& Cells, FHexPerturbCache* Cache, EHexChunkDetail Detail,
+        int32 Terraces, bool bWeld, FHexChunkMeshData& Mesh)
+    {
+        TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe> Roads = FHexChunkMeshPool::Acquire();
+        if (FHexChunkTriangulator(Snapshot, *Roads, Cache, false, Detail, Terraces).TriangulateRoads(Cells))
+        {
+            if (bWeld)
+            {
+                Roads->Weld();
+            }
+            Mesh.Roads = MoveTemp(Roads);
+        }
+    }
+}
 
 AHexGridChunk::AHexGridChunk()
 {
     PrimaryActorTick.bCanEverTick = true;
     PrimaryActorTick.bStartWithTickEnabled = false;
 
-    HexMeshComponent = CreateDefaultSubobject<UProceduralMeshComponent>(TEXT("HexMeshComponent"));
+    HexMeshComponent = CreateDefaultSubobject<UHexChunkMeshComponent>(TEXT("HexMeshComponent"));
     RootComponent = HexMeshComponent;
     HexMeshComponent->SetCollisionEnabled(ECollisionEnabled::QueryAndPhysics);
     HexMeshComponent->SetCollisionProfileName(TEXT("BlockAll"));
@@ -25,14 +44,29 @@ AHexGridChunk::AHexGridChunk()
         HexMeshComponent->SetMaterial(0, DefaultMaterial);
     }
 
-    RoadDecalMaterial = LoadObject<UMaterialInterface>(nullptr, TEXT("/Game/Materials/M_RoadDecal"));
-    if (!RoadDecalMaterial)
+    // Road vertex colour R runs from 0 at the sides to 1 on the centre line.
+    RoadMeshComponent = CreateDefaultSubobject<UHexChunkMeshComponent>(TEXT("RoadMeshComponent"));
+    RoadMeshComponent->SetupAttachment(RootComponent);
+    RoadMeshComponent->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+    RoadMeshComponent->SetCastShadow(false);
+
+    // M_Road is a surface material blending on vertex colour R. M_RoadDecal is
+    // a deferred decal and cannot draw a mesh, so without M_Road the roads fall
+    // back to the terrain material.
+    static ConstructorHelpers::FObjectFinder<UMaterialInterface> RoadMaterialFinder(TEXT("/Game/Materials/M_Road.M_Road"));
+    RoadMaterial = RoadMaterialFinder.Succeeded() ? RoadMaterialFinder.Object : DefaultMaterial;
+    if (!RoadMaterialFinder.Succeeded() && HasAnyFlags(RF_ClassDefaultObject))
     {
-        UE_LOG(LogTemp, Warning, TEXT("Failed to load M_RoadDecal material! Using fallback."));
-        RoadDecalMaterial = LoadObject<UMaterialInterface>(nullptr, TEXT("/Engine/EngineMaterials/DefaultDecalMaterial"));
+        UE_LOG(LogTemp, Warning, TEXT("HexGridChunk: /Game/Materials/M_Road not found, roads are drawn with %s"), *GetNameSafe(RoadMaterial));
+    }
+    if (RoadMaterial)
+    {
+        RoadMeshComponent->SetMaterial(0, RoadMaterial);
     }
 
-    Cells.SetNum(HexMetrics::ChunkSizeX * HexMetrics::ChunkSizeZ);
+    Grid = nullptr;
+    CellIndices.Init(INDEX_NONE, HexMetrics::ChunkSizeX * HexMetrics::ChunkSizeZ);
+    PerturbCache = MakeShared<FHexPerturbCache, ESPMode::ThreadSafe>();
 }
 
 void AHexGridChunk::BeginPlay()
@@ -41,452 +75,429 @@ void AHexGridChunk::BeginPlay()
     TriangulateCells();
 }
 
+void AHexGridChunk::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    if (InFlightCancel)
+    {
+        InFlightCancel->store(true, std::memory_order_relaxed);
+    }
+    Super::EndPlay(EndPlayReason);
+}
+
 void AHexGridChunk::Tick(float DeltaTime)
 {
     Super::Tick(DeltaTime);
     SetActorTickEnabled(false);
 }
 
-void AHexGridChunk::AddCell(int32 Index, AHexCell* Cell)
+void AHexGridChunk::ReleaseToPool()
 {
-    Cells[Index] = Cell;
-    Cell->Chunk = this;
+    // The cache is shared with a running build, which may still be using it.
+    if (bBuildInFlight)
+    {
+        PerturbCache = MakeShared<FHexPerturbCache, ESPMode::ThreadSafe>();
+    }
+    else
+    {
+        PerturbCache->Reset();
+    }
+
+    ClearMesh();
+    ClearCellInstances();
+    CellIndices.Init(INDEX_NONE, HexMetrics::ChunkSizeX * HexMetrics::ChunkSizeZ);
+    ChunkIndex = INDEX_NONE;
+
+    SetActorHiddenInGame(true);
+    SetActorEnableCollision(false);
 }
 
-void AHexGridChunk::Refresh()
+void AHexGridChunk::ClearMesh()
 {
-    TriangulateCells();
-    UE_LOG(LogTemp, Log, TEXT("AHexGridChunk::Refresh called, triangulating cells"));
+    // Results of a build still in flight no longer match BuildVersion and are dropped.
+    BuildVersion++;
+    bBuildPending = false;
+    if (InFlightCancel)
+    {
+        InFlightCancel->store(true, std::memory_order_relaxed);
+    }
+    ReadyMesh.Reset();
+
+    HexMeshComponent->ClearMesh();
+    RoadMeshComponent->ClearMesh();
+    AppliedVertexCount = INDEX_NONE;
+    bAppliedMeshWelded = false;
 }
 
-void AHexGridChunk::TriangulateCells()
+void AHexGridChunk::UpdateCellInstances()
 {
-    ClearMeshData();
+    const FHexCellStore& Store = Grid->GetCellStore();
 
-    for (AHexCell* Cell : Cells)
+    if (!CellInstances)
     {
-        if (!Cell) continue;
-        FVector Center = Cell->GetPosition();
-        FColor SRGBColor = Cell->Color.ToFColor(true);
-
-        // 㲢洢ŶĶ㣨ڸ Mesh
-        TArray<FVector> CellCorners;
-        CellCorners.SetNum(6);
-        for (int32 i = 0; i < 6; i++)
-        {
-            EHexDirection Direction = static_cast<EHexDirection>(i);
-            FVector Corner = Center + HexMetrics::GetFirstSolidCorner(Direction);
-            CellCorners[i] = HexMetrics::Perturb(Corner); // ӦŶ
-            UE_LOG(LogTemp, Log, TEXT("Cell (%d, %d) Corner %d: %s"),
-                Cell->Coordinates.X, Cell->Coordinates.Z, i, *CellCorners[i].ToString());
-        }
-        Cell->PerturbedCorners = CellCorners; // 洢 AHexCell
-
-        // ʹԭʼ߼ɸ Meshȷ㹲
-        for (int32 i = 0; i < 6; i++)
-        {
-            EHexDirection Direction = static_cast<EHexDirection>(i);
-            HexMetrics::FEdgeVertices E = HexMetrics::FEdgeVertices(
-                Center + HexMetrics::GetFirstSolidCorner(Direction),
-                Center + HexMetrics::GetSecondSolidCorner(Direction)
-            );
+        CellInstances = NewObject<UHierarchicalInstancedStaticMeshComponent>(this, TEXT("CellInstances"));
+        CellInstances->SetupAttachment(RootComponent);
+        CellInstances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+        CellInstances->NumCustomDataFloats = 4;
+        CellInstances->RegisterComponent();
+    }
+    if (CellInstances->GetStaticMesh() != Grid->CellInstanceMesh)
+    {
+        CellInstances->ClearInstances();
+        CellInstances->SetStaticMesh(Grid->CellInstanceMesh);
+    }
 
-            TriangulateEdgeFan(Center, E, SRGBColor);
+    TArray<FTransform> Transforms;
+    TArray<int32> Cells;
+    Transforms.Reserve(CellIndices.Num());
+    Cells.Reserve(CellIndices.Num());
+    for (int32 Cell : CellIndices)
+    {
+        if (!Store.IsValidIndex(Cell)) continue;
+        Transforms.Add(FTransform(FQuat::Identity, Store.GetPosition(Cell), Grid->CellInstanceScale));
+        Cells.Add(Cell);
+    }
 
-            if (Direction <= EHexDirection::SE)
-            {
-                TriangulateConnection(Direction, Cell, E);
-            }
-        }
+    // A chunk keeps the same cells while it is resident, so after the first
+    // fill an edit only moves instances and rewrites their custom data.
+    if (CellInstances->GetInstanceCount() != Transforms.Num())
+    {
+        CellInstances->ClearInstances();
+        CellInstances->AddInstances(Transforms, false, true);
+    }
+    else
+    {
+        CellInstances->BatchUpdateInstancesTransforms(0, Transforms, true, false);
     }
 
-    ApplyMesh();
+    for (int32 i = 0; i < Cells.Num(); i++)
+    {
+        const FLinearColor& Color = Store.GetColor(Cells[i]);
+        const float CustomData[4] = { Color.R, Color.G, Color.B, static_cast<float>(Store.GetElevation(Cells[i])) };
+        CellInstances->SetCustomData(i, MakeArrayView(CustomData, 4), false);
+    }
+    CellInstances->MarkRenderStateDirty();
 }
 
-void AHexGridChunk::AddTriangle(FVector V1, FVector V2, FVector V3)
+void AHexGridChunk::ClearCellInstances()
 {
-    int32 VertexIndex = Vertices.Num();
-    Vertices.Add(HexMetrics::Perturb(V1));
-    Vertices.Add(HexMetrics::Perturb(V2));
-    Vertices.Add(HexMetrics::Perturb(V3));
-
-    Normals.Add(FVector(0.0f, 0.0f, 1.0f));
-    Normals.Add(FVector(0.0f, 0.0f, 1.0f));
-    Normals.Add(FVector(0.0f, 0.0f, 1.0f));
-
-    Triangles.Add(VertexIndex);
-    Triangles.Add(VertexIndex + 1);
-    Triangles.Add(VertexIndex + 2);
+    if (CellInstances && CellInstances->GetInstanceCount() > 0)
+    {
+        CellInstances->ClearInstances();
+    }
 }
 
-void AHexGridChunk::AddTriangleColor(FColor C1, FColor C2, FColor C3)
+void AHexGridChunk::Activate()
 {
-    VertexColors.Add(C1);
-    VertexColors.Add(C2);
-    VertexColors.Add(C3);
+    SetActorHiddenInGame(false);
+    SetActorEnableCollision(true);
 }
 
-void AHexGridChunk::AddTriangleColor(FColor Color)
+void AHexGridChunk::AddCell(int32 Index, int32 CellIndex)
 {
-    VertexColors.Add(Color);
-    VertexColors.Add(Color);
-    VertexColors.Add(Color);
+    CellIndices[Index] = CellIndex;
 }
 
-void AHexGridChunk::AddQuad(FVector V1, FVector V2, FVector V3, FVector V4)
+void AHexGridChunk::Refresh()
 {
-    int32 VertexIndex = Vertices.Num();
-    Vertices.Add(HexMetrics::Perturb(V1));
-    Vertices.Add(HexMetrics::Perturb(V2));
-    Vertices.Add(HexMetrics::Perturb(V3));
-    Vertices.Add(HexMetrics::Perturb(V4));
-
-    Normals.Add(FVector(0.0f, 0.0f, 1.0f));
-    Normals.Add(FVector(0.0f, 0.0f, 1.0f));
-    Normals.Add(FVector(0.0f, 0.0f, 1.0f));
-    Normals.Add(FVector(0.0f, 0.0f, 1.0f));
-
-    Triangles.Add(VertexIndex);
-    Triangles.Add(VertexIndex + 2);
-    Triangles.Add(VertexIndex + 1);
-    Triangles.Add(VertexIndex + 1);
-    Triangles.Add(VertexIndex + 2);
-    Triangles.Add(VertexIndex + 3);
-}
+    if (Grid)
+    {
+        Grid->MarkChunkDirty(ChunkIndex);
+        return;
+    }
 
-void AHexGridChunk::AddQuadColor(FColor C1, FColor C2, FColor C3, FColor C4)
-{
-    VertexColors.Add(C1);
-    VertexColors.Add(C2);
-    VertexColors.Add(C3);
-    VertexColors.Add(C4);
+    TriangulateCells();
 }
 
-void AHexGridChunk::AddQuadColor(FColor C1, FColor C2)
+void AHexGridChunk::TriangulateCells()
 {
-    VertexColors.Add(C1);
-    VertexColors.Add(C1);
-    VertexColors.Add(C2);
-    VertexColors.Add(C2);
-}
+    if (!Grid)
+    {
+        ApplyMesh(FHexChunkMeshPool::Acquire());
+        return;
+    }
 
-void AHexGridChunk::AddQuadColor(FColor Color)
-{
-    VertexColors.Add(Color);
-    VertexColors.Add(Color);
-    VertexColors.Add(Color);
-    VertexColors.Add(Color);
+    if (Grid->UsesCellInstances())
+    {
+        ClearMesh();
+        UpdateCellInstances();
+        return;
+    }
+
+    ClearCellInstances();
+    RequestBuild(EHexChunkBuild::Full);
 }
 
-void AHexGridChunk::TriangulateEdgeFan(FVector Center, HexMetrics::FEdgeVertices Edge, FColor Color)
+void AHexGridChunk::RecolorCells()
 {
-    AddTriangle(Center, Edge.V1, Edge.V2);
-    AddTriangleColor(Color);
-    AddTriangle(Center, Edge.V2, Edge.V3);
-    AddTriangleColor(Color);
-    AddTriangle(Center, Edge.V3, Edge.V4);
-    AddTriangleColor(Color);
-    AddTriangle(Center, Edge.V4, Edge.V5);
-    AddTriangleColor(Color);
+    // Welded vertices are merged by colour, so new colours can change the vertex
+    // layout; those meshes, and chunks without a mesh yet, take the full path.
+    // So do chunks whose new geometry is still waiting for upload, since a
+    // colour pass only lines up with the mesh it was built against.
+    if (!Grid || Grid->UsesCellInstances() ||
+        AppliedVertexCount == INDEX_NONE || bAppliedMeshWelded || AppliedDetail != Grid->GetChunkDetail() ||
+        (ReadyMesh && ReadyBuild == EHexChunkBuild::Full))
+    {
+        TriangulateCells();
+        return;
+    }
+
+    RequestBuild(EHexChunkBuild::Colors);
 }
 
-void AHexGridChunk::TriangulateEdgeStrip(HexMetrics::FEdgeVertices E1, FColor C1, HexMetrics::FEdgeVertices E2, FColor C2)
+void AHexGridChunk::RequestBuild(EHexChunkBuild Kind)
 {
-    AddQuad(E1.V1, E1.V2, E2.V1, E2.V2);
-    AddQuadColor(C1, C2);
-    AddQuad(E1.V2, E1.V3, E2.V2, E2.V3);
-    AddQuadColor(C1, C2);
-    AddQuad(E1.V3, E1.V4, E2.V3, E2.V4);
-    AddQuadColor(C1, C2);
-    AddQuad(E1.V4, E1.V5, E2.V4, E2.V5);
-    AddQuadColor(C1, C2);
+    BuildVersion++;
+    if (bBuildInFlight)
+    {
+        // The cancelled build's work must be redone by the pending one.
+        InFlightCancel->store(true, std::memory_order_relaxed);
+        PendingBuild = bBuildPending ? FMath::Max(PendingBuild, Kind) : Kind;
+        PendingBuild = FMath::Max(PendingBuild, InFlightBuild);
+        bBuildPending = true;
+        return;
+    }
+
+    StartBuild(Kind);
 }
 
-void AHexGridChunk::TriangulateConnection(EHexDirection Direction, AHexCell* Cell, HexMetrics::FEdgeVertices E1)
+void AHexGridChunk::CreateSnapshot(FHexCellStore& OutSnapshot, TArray<int32>& OutCells) const
 {
-    AHexCell* Neighbor = Cell->GetNeighbor(Direction);
-    if (!Neighbor) return;
+    const FHexCellStore& Store = Grid->GetCellStore();
 
-    FVector Bridge = HexMetrics::GetBridge(Direction);
-    Bridge.Z = Neighbor->GetPosition().Z - Cell->GetPosition().Z;
-    HexMetrics::FEdgeVertices E2 = HexMetrics::FEdgeVertices(E1.V1 + Bridge, E1.V5 + Bridge, 1.0f / 6.0f);
+    int32 MinX = MAX_int32, MinZ = MAX_int32, MaxX = MIN_int32, MaxZ = MIN_int32;
+    for (int32 Cell : CellIndices)
+    {
+        if (!Store.IsValidIndex(Cell)) continue;
+        MinX = FMath::Min(MinX, Store.GetOffsetX(Cell));
+        MinZ = FMath::Min(MinZ, Store.GetOffsetZ(Cell));
+        MaxX = FMath::Max(MaxX, Store.GetOffsetX(Cell));
+        MaxZ = FMath::Max(MaxZ, Store.GetOffsetZ(Cell));
+    }
 
-    if (Cell->GetEdgeType(Direction) == HexMetrics::EHexEdgeType::Slope)
+    OutCells.Reset();
+    if (MinX > MaxX)
     {
-        TriangulateEdgeTerraces(E1, Cell, E2, Neighbor);
+        OutSnapshot.Reset();
+        return;
     }
-    else
+
+    // One ring of neighbours is enough for every connection and corner of the chunk.
+    Store.CreateSnapshot(MinX - 1, MinZ - 1, MaxX + 1, MaxZ + 1, OutSnapshot);
+
+    for (int32 Cell : CellIndices)
     {
-        TriangulateEdgeStrip(E1, Cell->Color.ToFColor(true), E2, Neighbor->Color.ToFColor(true));
+        if (!Store.IsValidIndex(Cell)) continue;
+        OutCells.Add(OutSnapshot.GetIndex(
+            Store.GetOffsetX(Cell) + Store.GetOriginX() - OutSnapshot.GetOriginX(),
+            Store.GetOffsetZ(Cell) + Store.GetOriginZ() - OutSnapshot.GetOriginZ()));
     }
+}
 
-    AHexCell* NextNeighbor = Cell->GetNeighbor(static_cast<EHexDirection>((static_cast<int32>(Direction) + 1) % 6));
-    if (Direction <= EHexDirection::E && NextNeighbor)
+void AHexGridChunk::StartBuild(EHexChunkBuild Kind)
+{
+    bBuildPending = false;
+    const int32 Version = BuildVersion;
+
+    FHexCellStore Snapshot;
+    TArray<int32> SnapshotCells;
+    CreateSnapshot(Snapshot, SnapshotCells);
+    const bool bWeld = Grid->bWeldChunkVertices;
+    const bool bCellData = Grid->GetCellDataTexture() != nullptr;
+    const bool bCollisionPrisms = Grid->ChunkCollision == EHexChunkCollision::Simplified;
+    const uint32 NoiseGeneration = HexMetrics::NoiseGeneration;
+    const EHexChunkDetail Detail = Grid->GetChunkDetail();
+    const int32 Terraces = Grid->TerracesPerSlope;
+
+    // Buffers come from the pool, sized from this chunk's last build: exact for
+    // a colour pass, and for a full build unless elevations changed.
+    TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe> Mesh = FHexChunkMeshPool::Acquire();
+    if (Kind == EHexChunkBuild::Colors)
+    {
+        Mesh->VertexColors.Reserve(AppliedVertexCount);
+    }
+    else
     {
-        FVector V5 = E1.V5 + HexMetrics::GetBridge(static_cast<EHexDirection>((static_cast<int32>(Direction) + 1) % 6));
-        V5.Z = NextNeighbor->GetPosition().Z;
+        Mesh->Reserve(LastRawVertexCount, LastRawIndexCount, bCellData);
+    }
 
-        if (Cell->Elevation <= Neighbor->Elevation)
+    if (!Grid->bAsyncTriangulation)
+    {
+        if (Kind == EHexChunkBuild::Colors)
         {
-            if (Cell->Elevation <= NextNeighbor->Elevation)
-            {
-                TriangulateCorner(E1.V5, Cell, E2.V5, Neighbor, V5, NextNeighbor);
-            }
-            else
-            {
-                TriangulateCorner(V5, NextNeighbor, E1.V5, Cell, E2.V5, Neighbor);
-            }
+            FHexChunkTriangulator(Snapshot, *Mesh, nullptr, bCellData, Detail, Terraces).TriangulateColors(SnapshotCells);
+            ApplyColors(*Mesh);
+            return;
         }
-        else if (Neighbor->Elevation <= NextNeighbor->Elevation)
+
+        PerturbCache->Validate(NoiseGeneration);
+        FHexChunkTriangulator Triangulator(Snapshot, *Mesh, PerturbCache.Get(), bCellData, Detail, Terraces);
+        Triangulator.Triangulate(SnapshotCells);
+        if (bCollisionPrisms)
         {
-            TriangulateCorner(E2.V5, Neighbor, V5, NextNeighbor, E1.V5, Cell);
+            Triangulator.BuildCollisionPrisms(SnapshotCells);
         }
-        else
+        if (bWeld)
         {
-            TriangulateCorner(V5, NextNeighbor, E1.V5, Cell, E2.V5, Neighbor);
+            Mesh->Weld();
         }
+        TriangulateRoads(Snapshot, SnapshotCells, PerturbCache.Get(), Detail, Terraces, bWeld, *Mesh);
+        ApplyMesh(Mesh);
+        return;
     }
-}
 
-void AHexGridChunk::TriangulateEdgeTerraces(HexMetrics::FEdgeVertices Begin, AHexCell* BeginCell, HexMetrics::FEdgeVertices End, AHexCell* EndCell)
-{
-    HexMetrics::FEdgeVertices E2 = HexMetrics::TerraceLerp(Begin, End, 1);
-    FLinearColor C2 = HexMetrics::TerraceLerp(BeginCell->Color, EndCell->Color, 1);
+    bBuildInFlight = true;
+    InFlightBuild = Kind;
+    InFlightCancel = MakeShared<std::atomic<bool>, ESPMode::ThreadSafe>(false);
 
-    TriangulateEdgeStrip(Begin, BeginCell->Color.ToFColor(true), E2, C2.ToFColor(true));
+    TWeakObjectPtr<AHexGridChunk> WeakThis(this);
+    AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask,
+        [WeakThis, Version, Kind, bWeld, bCellData, bCollisionPrisms, NoiseGeneration, Detail, Terraces, Cancel = InFlightCancel, Cache = PerturbCache,
+         Snapshot = MoveTemp(Snapshot), SnapshotCells = MoveTemp(SnapshotCells), Mesh = MoveTemp(Mesh)]() mutable
+        {
+            bool bCompleted;
+            if (Kind == EHexChunkBuild::Colors)
+            {
+                bCompleted = FHexChunkTriangulator(Snapshot, *Mesh, nullptr, bCellData, Detail, Terraces).TriangulateColors(SnapshotCells, Cancel.Get());
+            }
+            else
+            {
+                Cache->Validate(NoiseGeneration);
+                FHexChunkTriangulator Triangulator(Snapshot, *Mesh, Cache.Get(), bCellData, Detail, Terraces);
+                bCompleted = Triangulator.Triangulate(SnapshotCells, Cancel.Get());
+                if (bCompleted && bCollisionPrisms)
+                {
+                    Triangulator.BuildCollisionPrisms(SnapshotCells);
+                }
+                if (bCompleted && bWeld)
+                {
+                    Mesh->Weld();
+                }
+                if (bCompleted)
+                {
+                    TriangulateRoads(Snapshot, SnapshotCells, Cache.Get(), Detail, Terraces, bWeld, *Mesh);
+                }
+            }
 
-    for (int32 i = 2; i < HexMetrics::TerraceSteps; i++)
-    {
-        HexMetrics::FEdgeVertices E1 = E2;
-        FLinearColor C1 = C2;
-        E2 = HexMetrics::TerraceLerp(Begin, End, i);
-        C2 = HexMetrics::TerraceLerp(BeginCell->Color, EndCell->Color, i);
-        TriangulateEdgeStrip(E1, C1.ToFColor(true), E2, C2.ToFColor(true));
-    }
+            if (!bCompleted)
+            {
+                Mesh.Reset();
+            }
 
-    TriangulateEdgeStrip(E2, C2.ToFColor(true), End, EndCell->Color.ToFColor(true));
+            AsyncTask(ENamedThreads::GameThread, [WeakThis, Version, Kind, Mesh = MoveTemp(Mesh)]()
+            {
+                if (AHexGridChunk* Chunk = WeakThis.Get())
+                {
+                    Chunk->OnBuildCompleted(Version, Kind, Mesh);
+                }
+            });
+        });
 }
 
-void AHexGridChunk::TriangulateCorner(FVector Bottom, AHexCell* BottomCell, FVector Left, AHexCell* LeftCell, FVector Right, AHexCell* RightCell)
+void AHexGridChunk::OnBuildCompleted(int32 Version, EHexChunkBuild Kind, TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe> Mesh)
 {
-    HexMetrics::EHexEdgeType LeftEdgeType = BottomCell->GetEdgeType(LeftCell);
-    HexMetrics::EHexEdgeType RightEdgeType = BottomCell->GetEdgeType(RightCell);
+    bBuildInFlight = false;
+    InFlightCancel.Reset();
 
-    if (LeftEdgeType == HexMetrics::EHexEdgeType::Slope)
-    {
-        if (RightEdgeType == HexMetrics::EHexEdgeType::Slope)
-        {
-            TriangulateCornerTerraces(Bottom, BottomCell, Left, LeftCell, Right, RightCell);
-        }
-        else if (RightEdgeType == HexMetrics::EHexEdgeType::Flat)
-        {
-            TriangulateCornerTerraces(Left, LeftCell, Right, RightCell, Bottom, BottomCell);
-        }
-        else
-        {
-            TriangulateCornerTerracesCliff(Bottom, BottomCell, Left, LeftCell, Right, RightCell);
-        }
-    }
-    else if (RightEdgeType == HexMetrics::EHexEdgeType::Slope)
-    {
-        if (LeftEdgeType == HexMetrics::EHexEdgeType::Flat)
-        {
-            TriangulateCornerTerraces(Right, RightCell, Bottom, BottomCell, Left, LeftCell);
-        }
-        else
-        {
-            TriangulateCornerCliffTerraces(Bottom, BottomCell, Left, LeftCell, Right, RightCell);
-        }
-    }
-    else if (LeftCell->GetEdgeType(RightCell) == HexMetrics::EHexEdgeType::Slope)
+    // Results of superseded builds are dropped; the pending build replaces them.
+    if (Mesh && Version == BuildVersion)
     {
-        if (LeftCell->Elevation < RightCell->Elevation)
+        if (!ReadyMesh && Grid)
         {
-            TriangulateCornerCliffTerraces(Right, RightCell, Bottom, BottomCell, Left, LeftCell);
+            Grid->QueueChunkUpload(this);
         }
-        else
+        ReadyMesh = Mesh;
+        ReadyBuild = Kind;
+        ReadyVersion = Version;
+        if (!Grid)
         {
-            TriangulateCornerTerracesCliff(Left, LeftCell, Right, RightCell, Bottom, BottomCell);
+            ApplyReadyMesh();
         }
     }
-    else
+
+    if (bBuildPending)
     {
-        AddTriangle(Bottom, Left, Right);
-        AddTriangleColor(BottomCell->Color.ToFColor(true), LeftCell->Color.ToFColor(true), RightCell->Color.ToFColor(true));
+        StartBuild(PendingBuild);
     }
 }
 
-void AHexGridChunk::TriangulateCornerTerraces(FVector Begin, AHexCell* BeginCell, FVector Left, AHexCell* LeftCell, FVector Right, AHexCell* RightCell)
+void AHexGridChunk::ApplyReadyMesh()
 {
-    FVector V3 = HexMetrics::TerraceLerp(Begin, Left, 1);
-    FVector V4 = HexMetrics::TerraceLerp(Begin, Right, 1);
-    FLinearColor C3 = HexMetrics::TerraceLerp(BeginCell->Color, LeftCell->Color, 1);
-    FLinearColor C4 = HexMetrics::TerraceLerp(BeginCell->Color, RightCell->Color, 1);
-
-    AddTriangle(Begin, V3, V4);
-    AddTriangleColor(BeginCell->Color.ToFColor(true), C3.ToFColor(true), C4.ToFColor(true));
-
-    for (int32 i = 2; i < HexMetrics::TerraceSteps; i++)
-    {
-        FVector V1 = V3;
-        FVector V2 = V4;
-        FLinearColor C1 = C3;
-        FLinearColor C2 = C4;
-        V3 = HexMetrics::TerraceLerp(Begin, Left, i);
-        V4 = HexMetrics::TerraceLerp(Begin, Right, i);
-        C3 = HexMetrics::TerraceLerp(BeginCell->Color, LeftCell->Color, i);
-        C4 = HexMetrics::TerraceLerp(BeginCell->Color, RightCell->Color, i);
-        AddQuad(V1, V2, V3, V4);
-        AddQuadColor(C1.ToFColor(true), C2.ToFColor(true), C3.ToFColor(true), C4.ToFColor(true));
-    }
-
-    AddQuad(V3, V4, Left, Right);
-    AddQuadColor(C3.ToFColor(true), C4.ToFColor(true), LeftCell->Color.ToFColor(true), RightCell->Color.ToFColor(true));
-}
-
-void AHexGridChunk::TriangulateCornerTerracesCliff(FVector Begin, AHexCell* BeginCell, FVector Left, AHexCell* LeftCell, FVector Right, AHexCell* RightCell)
-{
-    float B = 1.0f / (RightCell->Elevation - BeginCell->Elevation);
-    if (B < 0) B = -B;
-    FVector Boundary = FMath::Lerp(HexMetrics::Perturb(Begin), HexMetrics::Perturb(Right), B);
-    FLinearColor BoundaryColor = FMath::Lerp(BeginCell->Color, RightCell->Color, B);
-
-    TriangulateBoundaryTriangle(Begin, BeginCell, Left, LeftCell, Boundary, BoundaryColor);
-
-    if (LeftCell->GetEdgeType(RightCell) == HexMetrics::EHexEdgeType::Slope)
+    if (!ReadyMesh)
     {
-        TriangulateBoundaryTriangle(Left, LeftCell, Right, RightCell, Boundary, BoundaryColor);
+        return;
     }
-    else
+
+    TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe> Mesh = MoveTemp(ReadyMesh);
+    if (ReadyVersion != BuildVersion)
     {
-        AddTriangleUnperturbed(HexMetrics::Perturb(Left), HexMetrics::Perturb(Right), Boundary);
-        AddTriangleColor(LeftCell->Color.ToFColor(true), RightCell->Color.ToFColor(true), BoundaryColor.ToFColor(true));
+        return;
     }
-}
-
-void AHexGridChunk::TriangulateCornerCliffTerraces(FVector Begin, AHexCell* BeginCell, FVector Left, AHexCell* LeftCell, FVector Right, AHexCell* RightCell)
-{
-    float B = 1.0f / (LeftCell->Elevation - BeginCell->Elevation);
-    if (B < 0) B = -B;
-    FVector Boundary = FMath::Lerp(HexMetrics::Perturb(Begin), HexMetrics::Perturb(Left), B);
-    FLinearColor BoundaryColor = FMath::Lerp(BeginCell->Color, LeftCell->Color, B);
 
-    TriangulateBoundaryTriangle(Right, RightCell, Begin, BeginCell, Boundary, BoundaryColor);
-
-    if (LeftCell->GetEdgeType(RightCell) == HexMetrics::EHexEdgeType::Slope)
+    if (ReadyBuild == EHexChunkBuild::Colors)
     {
-        TriangulateBoundaryTriangle(Left, LeftCell, Right, RightCell, Boundary, BoundaryColor);
+        ApplyColors(*Mesh);
     }
     else
     {
-        AddTriangleUnperturbed(HexMetrics::Perturb(Left), HexMetrics::Perturb(Right), Boundary);
-        AddTriangleColor(LeftCell->Color.ToFColor(true), RightCell->Color.ToFColor(true), BoundaryColor.ToFColor(true));
+        ApplyMesh(Mesh);
     }
 }
 
-void AHexGridChunk::TriangulateBoundaryTriangle(FVector Begin, AHexCell* BeginCell, FVector Left, AHexCell* LeftCell, FVector Boundary, FLinearColor BoundaryColor)
+void AHexGridChunk::ApplyMesh(TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe> MeshPtr)
 {
-    FVector V2 = HexMetrics::Perturb(HexMetrics::TerraceLerp(Begin, Left, 1));
-    FLinearColor C2 = HexMetrics::TerraceLerp(BeginCell->Color, LeftCell->Color, 1);
-
-    AddTriangleUnperturbed(HexMetrics::Perturb(Begin), V2, Boundary);
-    AddTriangleColor(BeginCell->Color.ToFColor(true), C2.ToFColor(true), BoundaryColor.ToFColor(true));
+    const FHexChunkMeshData& Mesh = *MeshPtr;
+    const int32 VertexCount = Mesh.NumVertices();
 
-    for (int32 i = 2; i < HexMetrics::TerraceSteps; i++)
+    // Cell data meshes pass their three cell indices in UV1.xy and UV2.x.
+    if (Mesh.CellIndices.Num() == VertexCount && VertexCount > 0)
     {
-        FVector V1 = V2;
-        FLinearColor C1 = C2;
-        V2 = HexMetrics::Perturb(HexMetrics::TerraceLerp(Begin, Left, i));
-        C2 = HexMetrics::TerraceLerp(BeginCell->Color, LeftCell->Color, i);
-        AddTriangleUnperturbed(V1, V2, Boundary);
-        AddTriangleColor(C1.ToFColor(true), C2.ToFColor(true), BoundaryColor.ToFColor(true));
+        if (!CellDataMaterial)
+        {
+            CellDataMaterial = HexMeshComponent->CreateDynamicMaterialInstance(0);
+            Grid->ApplyCellData(CellDataMaterial);
+        }
     }
 
-    AddTriangleUnperturbed(V2, HexMetrics::Perturb(Left), Boundary);
-    AddTriangleColor(C2.ToFColor(true), LeftCell->Color.ToFColor(true), BoundaryColor.ToFColor(true));
-}
-
-void AHexGridChunk::AddTriangleUnperturbed(FVector V1, FVector V2, FVector V3)
-{
-    int32 VertexIndex = Vertices.Num();
-    Vertices.Add(V1);
-    Vertices.Add(V2);
-    Vertices.Add(V3);
-
-    Normals.Add(FVector(0.0f, 0.0f, 1.0f));
-    Normals.Add(FVector(0.0f, 0.0f, 1.0f));
-    Normals.Add(FVector(0.0f, 0.0f, 1.0f));
-
-    Triangles.Add(VertexIndex);
-    Triangles.Add(VertexIndex + 1);
-    Triangles.Add(VertexIndex + 2);
-}
+    const EHexChunkCollision Collision = Grid ? Grid->ChunkCollision : EHexChunkCollision::None;
+    HexMeshComponent->bUseAsyncCooking = Grid && Grid->bAsyncCollisionCooking;
+    HexMeshComponent->bUseComplexAsSimpleCollision = Collision != EHexChunkCollision::Simplified;
 
-void AHexGridChunk::ClearMeshData()
-{
-    Vertices.Empty();
-    Triangles.Empty();
-    Normals.Empty();
-    VertexColors.Empty();
-    UV0.Empty();
-    Tangents.Empty();
-}
+    // Prisms, when built, go in as simple convex shapes, so the render mesh is never cooked.
+    HexMeshComponent->SetMesh(MeshPtr, Collision == EHexChunkCollision::Full);
+    if (Mesh.Roads)
+    {
+        RoadMeshComponent->SetMesh(Mesh.Roads, false);
+    }
+    else
+    {
+        RoadMeshComponent->ClearMesh();
+    }
 
-void AHexGridChunk::ApplyMesh()
-{
-    UV0.Init(FVector2D(0.0f, 0.0f), Vertices.Num());
-    Tangents.Init(FProcMeshTangent(1.0f, 0.0f, 0.0f), Vertices.Num());
-    HexMeshComponent->CreateMeshSection(0, Vertices, Triangles, Normals, UV0, VertexColors, Tangents, true);
-}
+    AppliedVertexCount = VertexCount;
+    LastRawVertexCount = Mesh.RawVertexCount;
+    LastRawIndexCount = Mesh.RawIndexCount;
+    bAppliedMeshWelded = Mesh.bWelded;
+    AppliedDetail = Mesh.Detail;
 
-void AHexGridChunk::ClearRoadDecals()
-{
-    for (UDecalComponent* Decal : RoadDecals)
+    if (Grid)
     {
-        if (Decal)
-        {
-            Decal->DestroyComponent();
-        }
+        Grid->RecordChunkMeshStats(ChunkIndex, Mesh);
     }
-    RoadDecals.Empty();
 }
 
-void AHexGridChunk::CreateRoadDecal(FVector Start, FVector End, float Width, UMaterialInterface* DecalMaterial)
+void AHexGridChunk::ApplyColors(const FHexChunkMeshData& Mesh)
 {
-    if (!DecalMaterial)
+    // The colour pass walks the same cells in the same order as the full build,
+    // so its colours line up with the current vertices as long as the counts do.
+    if (Mesh.VertexColors.Num() != AppliedVertexCount)
     {
-        LOG_TO_FILE(LogTemp, Warning, TEXT("CreateRoadDecal: DecalMaterial is null"));
+        UE_LOG(LogTemp, Warning, TEXT("Chunk %d: colour pass produced %d colours for %d vertices, rebuilding"),
+            ChunkIndex, Mesh.VertexColors.Num(), AppliedVertexCount);
+        TriangulateCells();
         return;
     }
 
-    FVector DecalLocation = (Start + End) * 0.5f;
-    FVector Direction = (End - Start).GetSafeNormal();
-    FRotator DecalRotation = Direction.Rotation();
-    float Length = (End - Start).Size();
-
-    FHitResult HitResult;
-    FVector TraceStart = DecalLocation + FVector(0, 0, 1000);
-    FVector TraceEnd = DecalLocation - FVector(0, 0, 1000);
-    if (GetWorld()->LineTraceSingleByChannel(HitResult, TraceStart, TraceEnd, ECC_Visibility))
-    {
-        DecalLocation.Z = HitResult.Location.Z + 0.01f;
-    }
-
-    UDecalComponent* Decal = NewObject<UDecalComponent>(this, NAME_None);
-    Decal->RegisterComponent();
-    Decal->AttachToComponent(RootComponent, FAttachmentTransformRules::KeepWorldTransform);
-    Decal->SetRelativeLocation(DecalLocation);
-    Decal->SetRelativeRotation(DecalRotation);
-    Decal->DecalSize = FVector(Length * 0.5f, Width, 10.0f);
-    Decal->SetDecalMaterial(DecalMaterial);
-    Decal->SetFadeScreenSize(0.0f);
-
-    RoadDecals.Add(Decal);
-
-    LOG_TO_FILE(LogTemp, Log, TEXT("Created road decal from (%f, %f) to (%f, %f), Size=(%f, %f, %f), Visibility=%s, Material=%s"),
-        Start.X, Start.Y, End.X, End.Y,
-        Decal->DecalSize.X, Decal->DecalSize.Y, Decal->DecalSize.Z,
-        Decal->IsVisible() ? TEXT("Visible") : TEXT("Hidden"),
-        *GetNameSafe(DecalMaterial));
+    // Only the vertex ranges whose colour changed are uploaded; geometry and
+    // collision are untouched.
+    HexMeshComponent->UpdateColors(Mesh.VertexColors);
 }
-
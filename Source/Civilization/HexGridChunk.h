@@ -2,13 +2,26 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "HexMetrics.h"
-#include "ProceduralMeshComponent.h"
+#include <atomic>
 #include "HexGridChunk.generated.h"
 
 
-class AHexCell;
-class UProceduralMeshComponent;
-class UDecalComponent;
+class AHexGrid;
+struct FHexCellStore;
+struct FHexChunkMeshData;
+enum class EHexChunkDetail : uint8;
+class FHexPerturbCache;
+class UHexChunkMeshComponent;
+class UHierarchicalInstancedStaticMeshComponent;
+class UMaterialInstanceDynamic;
+
+// What a chunk build recomputes. A colour build keeps the current geometry and
+// only replaces vertex colours.
+enum class EHexChunkBuild : uint8
+{
+    Colors,
+    Full
+};
 
 UCLASS()
 class CIVILIZATION_API AHexGridChunk : public AActor
@@ -18,54 +31,94 @@ class CIVILIZATION_API AHexGridChunk : public AActor
 public:
     AHexGridChunk();
     virtual void BeginPlay() override;
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
     virtual void Tick(float DeltaTime) override;
 
-    void AddCell(int32 Index, AHexCell* Cell);
+    void SetGrid(AHexGrid* InGrid, int32 InChunkIndex) { Grid = InGrid; ChunkIndex = InChunkIndex; }
+
+    // Detaches the chunk from its slot so the grid can pool it: drops any build
+    // in flight, the mesh, collision and cells, and hides the actor. A pooled
+    // chunk is rebound with SetGrid, AddCell and Activate.
+    void ReleaseToPool();
+    void Activate();
+
+    // Uploads the last finished build, if it is still current. Builds are not
+    // uploaded as they finish but when the grid's frame budget allows.
+    void ApplyReadyMesh();
+    int32 GetChunkIndex() const { return ChunkIndex; }
+    void AddCell(int32 Index, int32 CellIndex);
     void Refresh();
+
+    // Starts a rebuild of the chunk mesh. Triangulation runs on a task-graph
+    // worker against a snapshot of the cells; only the upload happens here.
     void TriangulateCells();
 
-    // غ
-    void ClearRoadDecals();
-    void CreateRoadDecal(FVector Start, FVector End, float Width, UMaterialInterface* DecalMaterial);
+    // Rebuilds vertex colours only, for edits that cannot change geometry.
+    // Positions, indices and collision are left as they are.
+    // In the grid's instanced modes both of these update cell instances instead.
+    void RecolorCells();
 
-    UMaterialInterface* RoadDecalMaterial;
 protected:
     UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Components")
-    UProceduralMeshComponent* HexMeshComponent;
+    UHexChunkMeshComponent* HexMeshComponent;
 
+    // Roads of the chunk's cells, triangulated with the terrain in every full
+    // build and drawn with RoadMaterial.
     UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Components")
-    TArray<UDecalComponent*> RoadDecals;
+    UHexChunkMeshComponent* RoadMeshComponent;
+
+    // One instance per cell, created the first time the chunk is drawn instanced.
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Components")
+    UHierarchicalInstancedStaticMeshComponent* CellInstances = nullptr;
 
     UPROPERTY()
-    TArray<AHexCell*> Cells;
-
-    // 
-    TArray<FVector> Vertices;
-    TArray<int32> Triangles;
-    TArray<FVector> Normals;
-    TArray<FColor> VertexColors;
-    TArray<FVector2D> UV0;
-    TArray<FProcMeshTangent> Tangents;
-
-
-    void AddTriangle(FVector V1, FVector V2, FVector V3);
-    void AddTriangleColor(FColor C1, FColor C2, FColor C3);
-    void AddTriangleColor(FColor Color);
-    void AddQuad(FVector V1, FVector V2, FVector V3, FVector V4);
-    void AddQuadColor(FColor C1, FColor C2, FColor C3, FColor C4);
-    void AddQuadColor(FColor C1, FColor C2);
-    void AddQuadColor(FColor Color);
-
-    void TriangulateEdgeFan(FVector Center, HexMetrics::FEdgeVertices Edge, FColor Color);
-    void TriangulateEdgeStrip(HexMetrics::FEdgeVertices E1, FColor C1, HexMetrics::FEdgeVertices E2, FColor C2);
-    void TriangulateConnection(EHexDirection Direction, AHexCell* Cell, HexMetrics::FEdgeVertices E1);
-    void TriangulateEdgeTerraces(HexMetrics::FEdgeVertices Begin, AHexCell* BeginCell, HexMetrics::FEdgeVertices End, AHexCell* EndCell);
-    void TriangulateCorner(FVector Bottom, AHexCell* BottomCell, FVector Left, AHexCell* LeftCell, FVector Right, AHexCell* RightCell);
-    void TriangulateCornerTerraces(FVector Begin, AHexCell* BeginCell, FVector Left, AHexCell* LeftCell, FVector Right, AHexCell* RightCell);
-    void TriangulateCornerTerracesCliff(FVector Begin, AHexCell* BeginCell, FVector Left, AHexCell* LeftCell, FVector Right, AHexCell* RightCell);
-    void TriangulateCornerCliffTerraces(FVector Begin, AHexCell* BeginCell, FVector Left, AHexCell* LeftCell, FVector Right, AHexCell* RightCell);
-    void TriangulateBoundaryTriangle(FVector Begin, AHexCell* BeginCell, FVector Left, AHexCell* LeftCell, FVector Boundary, FLinearColor BoundaryColor);
-    void AddTriangleUnperturbed(FVector V1, FVector V2, FVector V3);
+    AHexGrid* Grid;
+
+    int32 ChunkIndex = INDEX_NONE;
+
+    // Indices into the grid's cell store, by local offset inside the chunk.
+    TArray<int32> CellIndices;
+
+    // Build state, only touched on the game thread. At most one build is in
+    // flight; edits arriving meanwhile bump BuildVersion, cancel it and queue
+    // another build, so stale results are dropped instead of uploaded.
+    int32 BuildVersion = 0;
+    bool bBuildInFlight = false;
+    bool bBuildPending = false;
+    EHexChunkBuild InFlightBuild = EHexChunkBuild::Full;
+    EHexChunkBuild PendingBuild = EHexChunkBuild::Full;
+    TSharedPtr<std::atomic<bool>, ESPMode::ThreadSafe> InFlightCancel;
+
+    // Finished build queued with the grid for upload.
+    TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe> ReadyMesh;
+    EHexChunkBuild ReadyBuild = EHexChunkBuild::Full;
+    int32 ReadyVersion = 0;
+
+    // Layout of the uploaded section, checked before a colour-only update.
+    int32 AppliedVertexCount = INDEX_NONE;
+    bool bAppliedMeshWelded = false;
+    EHexChunkDetail AppliedDetail{};
+
+    // Size of the last full build before welding, used to size the next one.
+    int32 LastRawVertexCount = 0;
+    int32 LastRawIndexCount = 0;
+
+    // Perturbed positions reused across rebuilds. Shared with the in-flight
+    // build, which is the only user while it runs.
+    TSharedPtr<FHexPerturbCache, ESPMode::ThreadSafe> PerturbCache;
+
+    // Drops the chunk and road meshes and any build that would replace them.
+    void ClearMesh();
+
+    // Writes the chunk's cells to CellInstances: position from the cell centre
+    // and elevation, custom data R, G, B and elevation.
+    void UpdateCellInstances();
+    void ClearCellInstances();
+
+    void RequestBuild(EHexChunkBuild Kind);
+    void StartBuild(EHexChunkBuild Kind);
+    void CreateSnapshot(FHexCellStore& OutSnapshot, TArray<int32>& OutCells) const;
+    void OnBuildCompleted(int32 Version, EHexChunkBuild Kind, TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe> Mesh);
 
     UPROPERTY()
     UMaterialInterface* DefaultMaterial;
@@ -73,6 +126,13 @@ protected:
     UPROPERTY()
     UMaterialInterface* HighlightMaterial;
 
-    void ClearMeshData();
-    void ApplyMesh();
+    UPROPERTY()
+    UMaterialInterface* RoadMaterial;
+
+    // Per-chunk instance of the mesh material, bound to the grid's cell data texture.
+    UPROPERTY()
+    UMaterialInstanceDynamic* CellDataMaterial = nullptr;
+
+    void ApplyMesh(TSharedPtr<FHexChunkMeshData, ESPMode::ThreadSafe> MeshPtr);
+    void ApplyColors(const FHexChunkMeshData& Mesh);
 };
\ No newline at end of file
@@ -11,7 +11,7 @@ UHexMapEditor::UHexMapEditor()
 {
     PrimaryComponentTick.bCanEverTick = true;
     bIsFirstClick = true;
-    PreviousCell = nullptr;
+    PreviousCellIndex = INDEX_NONE;
     CurrentHighlightedCell = nullptr; // ʼ
     BrushSize = 1;
     ActiveElevation = 0;
@@ -24,7 +24,7 @@ void UHexMapEditor::BeginPlay()
 {
     Super::BeginPlay();
     bIsFirstClick = true;
-    PreviousCell = nullptr;
+    PreviousCellIndex = INDEX_NONE;
     CurrentHighlightedCell = nullptr;
     APlayerController* PC = GetWorld()->GetFirstPlayerController();
     if (PC)
@@ -91,6 +91,20 @@ void UHexMapEditor::BeginPlay()
         }
     }
 
+    // A grid with a palette of its own, set up in the level or loaded with a
+    // map, keeps it and the editor paints with those colours instead.
+    if (HexGrid && HexGrid->CellPalette.Num() > 0)
+    {
+        Colors = HexGrid->CellPalette;
+    }
+    else if (HexGrid && Colors.Num() > 0)
+    {
+        HexGrid->SetCellPalette(Colors);
+    }
+    if (HexGrid)
+    {
+        HexGrid->OnCellPaletteChanged.AddUniqueDynamic(this, &UHexMapEditor::HandleCellPaletteChanged);
+    }
     SelectColor(0);
     //SetBrushSize(1);
 }
@@ -105,8 +119,88 @@ void UHexMapEditor::TickComponent(float DeltaTime, ELevelTick TickType, FActorCo
     if (PC && PC->WasInputKeyJustPressed(EKeys::LeftMouseButton))
     {
         UE_LOG(LogTemp, Log, TEXT("Left mouse clicked, bIsFirstClick=%s"), bIsFirstClick ? TEXT("true") : TEXT("false"));
+        bStrokeActive = false;
         HandleInput();
     }
+    else if (PC && bStrokeActive && PC->IsInputKeyDown(EKeys::LeftMouseButton))
+    {
+        ContinueStroke();
+    }
+    else
+    {
+        bStrokeActive = false;
+    }
+
+    FlushStroke();
+}
+
+void UHexMapEditor::ContinueStroke()
+{
+    APlayerController* PC = GetWorld()->GetFirstPlayerController();
+    FVector WorldPos, WorldDir;
+    if (!HexGrid || !PC || !PC->DeprojectMousePositionToWorld(WorldPos, WorldDir))
+    {
+        return;
+    }
+
+    const int32 CurrentCell = HexGrid->PickCell(WorldPos, WorldDir, 10000.f);
+    if (CurrentCell == INDEX_NONE)
+    {
+        return;
+    }
+
+    const FHexCellStore& Store = HexGrid->GetCellStore();
+    const FHexAxial Current = Store.GetAxial(CurrentCell);
+    if (Current == LastStrokeCell)
+    {
+        return;
+    }
+
+    // Fill in every cell between the last sample and this one, so fast drags
+    // leave a continuous line instead of isolated stamps.
+    bool bFirst = true;
+    for (const FHexAxial& Cell : HexMath::Line(LastStrokeCell, Current))
+    {
+        if (!bFirst)
+        {
+            PendingStamps.Add(Cell);
+        }
+        bFirst = false;
+    }
+    LastStrokeCell = Current;
+
+    AHexCell* Proxy = HexGrid->AcquireCellProxy(CurrentCell);
+    if (CurrentHighlightedCell && CurrentHighlightedCell != Proxy)
+    {
+        HexGrid->ReleaseCellProxy(CurrentHighlightedCell);
+    }
+    if (Proxy)
+    {
+        Proxy->SetHighlighted(true);
+    }
+    CurrentHighlightedCell = Proxy;
+}
+
+void UHexMapEditor::FlushStroke()
+{
+    if (PendingStamps.Num() == 0 || !HexGrid)
+    {
+        PendingStamps.Reset();
+        return;
+    }
+
+    // BrushSize 1 paints a single cell; each step above adds one ring.
+    FHexCellEdit Edit;
+    Edit.bApplyColor = EditMode == EEditMode::Color;
+    Edit.ColorIndex = static_cast<uint8>(ActiveColorIndex);
+    Edit.bApplyElevation = EditMode == EEditMode::Elevation;
+    Edit.Elevation = ActiveElevation;
+
+    const int32 Radius = FMath::Max(BrushSize - 1, 0);
+    const int32 ChangedCount = HexGrid->ApplyBrushStroke(PendingStamps, Radius, Edit);
+    UE_LOG(LogTemp, Verbose, TEXT("FlushStroke: %d stamps of radius %d changed %d cells"),
+        PendingStamps.Num(), Radius, ChangedCount);
+    PendingStamps.Reset();
 }
 
 void UHexMapEditor::ShowEditorUI(bool bVisible)
@@ -136,167 +230,118 @@ void UHexMapEditor::HandleInput()
         return;
     }
 
-    FHitResult HitResult;
-    if (GetWorld()->LineTraceSingleByChannel(HitResult, WorldPos, WorldPos + WorldDir * 10000.f, ECC_Visibility))
+    FVector HitLocation;
+    int32 CurrentCell = HexGrid->PickCell(WorldPos, WorldDir, 10000.f, &HitLocation);
+    if (CurrentCell != INDEX_NONE)
     {
-        AHexCell* CurrentCell = HexGrid->GetCellByPosition(HitResult.Location);
-        UE_LOG(LogTemp, Log, TEXT("HandleInput: Hit at (%f, %f, %f), Cell=%s"),
-            HitResult.Location.X, HitResult.Location.Y, HitResult.Location.Z,
-            CurrentCell ? *GetNameSafe(CurrentCell) : TEXT("nullptr"));
-        if (CurrentCell)
-        {
-            EditCells(CurrentCell);
-        }
-        else
-        {
-            UE_LOG(LogTemp, Warning, TEXT("No cell found at hit position!"));
-        }
+        UE_LOG(LogTemp, Verbose, TEXT("HandleInput: Hit at (%f, %f, %f), Cell=%d"),
+            HitLocation.X, HitLocation.Y, HitLocation.Z, CurrentCell);
+        EditCells(CurrentCell);
     }
     else
     {
-        UE_LOG(LogTemp, Warning, TEXT("Line trace failed!"));
+        UE_LOG(LogTemp, Warning, TEXT("No cell found under the cursor!"));
     }
 }
 
-void UHexMapEditor::EditCells(AHexCell* Center)
+void UHexMapEditor::EditCells(int32 Center)
 {
-    if (!Center || !HexGrid)
+    if (Center == INDEX_NONE || !HexGrid)
     {
-        LOG_TO_FILE(LogTemp, Warning, TEXT("EditCells: Center=%s, HexGrid=%s"),
-            Center ? *GetNameSafe(Center) : TEXT("nullptr"),
+        LOG_TO_FILE(LogTemp, Warning, TEXT("EditCells: Center=%d, HexGrid=%s"),
+            Center,
             HexGrid ? *GetNameSafe(HexGrid) : TEXT("nullptr"));
         return;
     }
 
-    if (!Center->Chunk)
+    if (!HexGrid->GetChunkForCell(Center))
     {
         LOG_TO_FILE(LogTemp, Warning, TEXT("EditCells: Center cell has no Chunk assigned!"));
         return;
     }
 
+    const FHexCellStore& Store = HexGrid->GetCellStore();
+    const FHexCoordinates CenterCoordinates = Store.GetCoordinates(Center);
     LOG_TO_FILE(LogTemp, Log, TEXT("EditCells: Center at (%d, %d), BrushSize=%d"),
-        Center->Coordinates.X, Center->Coordinates.Z, BrushSize);
+        CenterCoordinates.X, CenterCoordinates.Z, BrushSize);
 
     // ȷһ
-    if (CurrentHighlightedCell && CurrentHighlightedCell != Center)
+    AHexCell* CenterProxy = HexGrid->AcquireCellProxy(Center);
+    if (CurrentHighlightedCell && CurrentHighlightedCell != CenterProxy)
     {
-        CurrentHighlightedCell->SetHighlighted(false);
+        HexGrid->ReleaseCellProxy(CurrentHighlightedCell);
     }
-    Center->SetHighlighted(true);
-    CurrentHighlightedCell = Center;
-
-    if (EditMode == EEditMode::Road || EditMode == EEditMode::Elevation || BrushSize <= 1)
-    {
-        EditCell(Center);
-    }
-    else
+    if (CenterProxy)
     {
-        TArray<AHexCell*> CellsToEdit;
-        CellsToEdit.Add(Center);
-        for (int32 Ring = 1; Ring <= BrushSize; Ring++)
-        {
-            for (int32 Dir = 0; Dir < 6; Dir++)
-            {
-                EHexDirection Direction = static_cast<EHexDirection>(Dir);
-                AHexCell* Neighbor = Center;
-                for (int32 Step = 0; Step < Ring; Step++)
-                {
-                    if (Neighbor)
-                    {
-                        Neighbor = Neighbor->GetNeighbor(Direction);
-                    }
-                }
-                if (Neighbor)
-                {
-                    CellsToEdit.AddUnique(Neighbor);
-                    for (int32 NeighborDir = 0; NeighborDir < 6; NeighborDir++)
-                    {
-                        AHexCell* SubNeighbor = Neighbor->GetNeighbor(static_cast<EHexDirection>(NeighborDir));
-                        if (SubNeighbor)
-                        {
-                            CellsToEdit.AddUnique(SubNeighbor);
-                        }
-                    }
-                }
-            }
-        }
-
-        for (AHexCell* Cell : CellsToEdit)
-        {
-            EditCell(Cell);
-        }
+        CenterProxy->SetHighlighted(true);
     }
+    CurrentHighlightedCell = CenterProxy;
 
-    if (EditMode != EEditMode::Road || RoadMode == EEditRoadMode::No)
+    if (EditMode == EEditMode::Road)
     {
-        HexGrid->Refresh();
+        EditCell(Center);
+        return;
     }
+
+    // The stamp is applied with the rest of the stroke at the end of the tick.
+    LastStrokeCell = Store.GetAxial(Center);
+    PendingStamps.Add(LastStrokeCell);
+    bStrokeActive = true;
 }
 
-void UHexMapEditor::EditCell(AHexCell* Cell)
+void UHexMapEditor::EditCell(int32 Cell)
 {
-    if (!Cell)
+    if (Cell == INDEX_NONE)
     {
-        UE_LOG(LogTemp, Warning, TEXT("EditCell: Cell is null!"));
+        UE_LOG(LogTemp, Warning, TEXT("EditCell: Cell is invalid!"));
         return;
     }
 
+    const FHexCellStore& Store = HexGrid->GetCellStore();
+    const FHexCoordinates Coordinates = Store.GetCoordinates(Cell);
+
+    // Colour and elevation are applied by the stroke in EditCells, only roads
+    // are edited one cell at a time.
     switch (EditMode)
     {
-    case EEditMode::Color:
-        Cell->Color = ActiveColor;
-        UE_LOG(LogTemp, Log, TEXT("Set cell (%d, %d) color to %s"),
-            Cell->Coordinates.X, Cell->Coordinates.Z, *ActiveColor.ToString());
-        if (Cell->Chunk)
-        {
-            Cell->Chunk->Refresh();
-        }
-        break;
-    case EEditMode::Elevation:
-        Cell->SetElevation(ActiveElevation);
-        break;
     case EEditMode::Road:
         switch (RoadMode)
         {
         case EEditRoadMode::No:
-            Cell->RemoveRoad();
-            if (Cell->Chunk)
-            {
-                Cell->Chunk->ClearRoadDecals();
-            }
+            HexGrid->RemoveRoad(Cell);
             break;
         case EEditRoadMode::Yes:
-            UE_LOG(LogTemp, Log, TEXT("Road mode: bIsFirstClick=%s, PreviousCell=%s"),
-                bIsFirstClick ? TEXT("true") : TEXT("false"),
-                PreviousCell ? *GetNameSafe(PreviousCell) : TEXT("nullptr"));
+            UE_LOG(LogTemp, Log, TEXT("Road mode: bIsFirstClick=%s, PreviousCell=%d"),
+                bIsFirstClick ? TEXT("true") : TEXT("false"), PreviousCellIndex);
             if (bIsFirstClick)
             {
-                if (PreviousCell && PreviousCell != Cell)
+                if (PreviousCellIndex != INDEX_NONE && PreviousCellIndex != Cell)
                 {
+                    const FHexCoordinates PreviousCoordinates = Store.GetCoordinates(PreviousCellIndex);
                     UE_LOG(LogTemp, Log, TEXT("Clearing previous highlight for cell (%d, %d)"),
-                        PreviousCell->Coordinates.X, PreviousCell->Coordinates.Z);
+                        PreviousCoordinates.X, PreviousCoordinates.Z);
                 }
-                PreviousCell = Cell;
+                PreviousCellIndex = Cell;
                 bIsFirstClick = false;
                 UE_LOG(LogTemp, Log, TEXT("First click on cell (%d, %d), waiting for second click"),
-                    Cell->Coordinates.X, Cell->Coordinates.Z);
+                    Coordinates.X, Coordinates.Z);
             }
             else
             {
-                if (!PreviousCell)
+                if (PreviousCellIndex == INDEX_NONE)
                 {
                     UE_LOG(LogTemp, Warning, TEXT("PreviousCell is null on second click, resetting"));
-                    PreviousCell = Cell;
+                    PreviousCellIndex = Cell;
                     bIsFirstClick = false;
                     UE_LOG(LogTemp, Log, TEXT("Reset to first click on cell (%d, %d)"),
-                        Cell->Coordinates.X, Cell->Coordinates.Z);
+                        Coordinates.X, Coordinates.Z);
                     break;
                 }
 
-                if (PreviousCell == Cell)
+                if (PreviousCellIndex == Cell)
                 {
                     UE_LOG(LogTemp, Log, TEXT("Same cell clicked again, clearing highlight"));
-                    PreviousCell = nullptr;
+                    PreviousCellIndex = INDEX_NONE;
                     bIsFirstClick = true;
                     break;
                 }
@@ -306,8 +351,7 @@ void UHexMapEditor::EditCell(AHexCell* Cell)
                 for (int32 i = 0; i < 6; i++)
                 {
                     EHexDirection Dir = static_cast<EHexDirection>(i);
-                    AHexCell* Neighbor = PreviousCell->GetNeighbor(Dir);
-                    if (Neighbor == Cell)
+                    if (Store.GetNeighbor(PreviousCellIndex, Dir) == Cell)
                     {
                         bIsNeighbor = true;
                         NeighborDirection = Dir;
@@ -315,30 +359,26 @@ void UHexMapEditor::EditCell(AHexCell* Cell)
                     }
                 }
 
+                const FHexCoordinates PreviousCoordinates = Store.GetCoordinates(PreviousCellIndex);
                 UE_LOG(LogTemp, Log, TEXT("Clearing previous highlight for cell (%d, %d)"),
-                    PreviousCell->Coordinates.X, PreviousCell->Coordinates.Z);
+                    PreviousCoordinates.X, PreviousCoordinates.Z);
 
                 if (bIsNeighbor)
                 {
-                    PreviousCell->SetOutgoingRoad(NeighborDirection);
-                    if (PreviousCell->Chunk)
-                    {
-                        FVector Start = PreviousCell->GetPosition();
-                        FVector End = Cell->GetPosition();
-                        PreviousCell->Chunk->CreateRoadDecal(Start, End, 0.5f, PreviousCell->Chunk->RoadDecalMaterial);
-                        UE_LOG(LogTemp, Log, TEXT("Road created from (%d, %d) to (%d, %d), Direction: %d"),
-                            PreviousCell->Coordinates.X, PreviousCell->Coordinates.Z,
-                            Cell->Coordinates.X, Cell->Coordinates.Z, static_cast<int32>(NeighborDirection));
-                    }
+                    // The road mesh is rebuilt with the chunks of both cells.
+                    HexGrid->SetOutgoingRoad(PreviousCellIndex, NeighborDirection);
+                    UE_LOG(LogTemp, Log, TEXT("Road created from (%d, %d) to (%d, %d), Direction: %d"),
+                        PreviousCoordinates.X, PreviousCoordinates.Z,
+                        Coordinates.X, Coordinates.Z, static_cast<int32>(NeighborDirection));
                 }
                 else
                 {
                     UE_LOG(LogTemp, Warning, TEXT("Second click on (%d, %d) is not a neighbor of (%d, %d), please select a neighboring cell"),
-                        Cell->Coordinates.X, Cell->Coordinates.Z,
-                        PreviousCell->Coordinates.X, PreviousCell->Coordinates.Z);
+                        Coordinates.X, Coordinates.Z,
+                        PreviousCoordinates.X, PreviousCoordinates.Z);
                 }
 
-                PreviousCell = Cell;
+                PreviousCellIndex = Cell;
                 bIsFirstClick = false;
             }
             break;
@@ -347,15 +387,26 @@ void UHexMapEditor::EditCell(AHexCell* Cell)
             break;
         }
         break;
+    default:
+        break;
+    }
+}
+
+void UHexMapEditor::HandleCellPaletteChanged()
+{
+    Colors = HexGrid->CellPalette;
+    if (!Colors.IsValidIndex(ActiveColorIndex))
+    {
+        SelectColor(0);
     }
 }
 
 void UHexMapEditor::SelectColor(int32 Index)
 {
-    if (Colors.IsValidIndex(Index))
+    if (Colors.IsValidIndex(Index) && Index < FHexCellPalette::MaxColors)
     {
-        ActiveColor = Colors[Index];
-        UE_LOG(LogTemp, Log, TEXT("Selected color index: %d, Color: %s"), Index, *ActiveColor.ToString());
+        ActiveColorIndex = Index;
+        UE_LOG(LogTemp, Log, TEXT("Selected color index: %d, Color: %s"), Index, *Colors[Index].ToString());
     }
 }
 
@@ -46,6 +46,9 @@ public:
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexMapEditor")
     AHexGrid* HexGrid;
 
+    // Palette the editor paints with. At BeginPlay it becomes the grid's
+    // CellPalette if the grid has none, and is replaced by the grid's otherwise.
+    // After that it follows the grid's palette, e.g. when a map is loaded.
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "HexMapEditor")
     TArray<FLinearColor> Colors;
 
@@ -79,17 +82,27 @@ protected:
     int32 ActiveElevation = 0;
 
     UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "HexMapEditor")
-    FLinearColor ActiveColor;
+    int32 ActiveColorIndex = 0;
 
-    UPROPERTY(Transient)
-    AHexCell* PreviousCell;
+    int32 PreviousCellIndex = INDEX_NONE;
+
+    // Drag stroke state. Cells crossed while the button is held are queued as
+    // brush stamps and applied as one batch at the end of the tick.
+    bool bStrokeActive = false;
+    FHexAxial LastStrokeCell;
+    TArray<FHexAxial> PendingStamps;
 
     UPROPERTY()
     bool bIsFirstClick;
 
     void HandleInput();
-    void EditCells(AHexCell* Center);
-    void EditCell(AHexCell* Cell);
+    void ContinueStroke();
+    void FlushStroke();
+    void EditCells(int32 Center);
+    void EditCell(int32 Cell);
+
+    UFUNCTION()
+    void HandleCellPaletteChanged();
 
     void MoveCameraForward(float AxisValue);
     void MoveCameraRight(float AxisValue);
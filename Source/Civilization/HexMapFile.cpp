@@ -0,0 +1,355 @@
+#include "HexMapFile.h"
+#include "HexCellStore.h"
+#include "HAL/FileManager.h"
+#include "Async/ParallelFor.h"
+#include "Misc/Compression.h"
+#include "HAL/PlatformFileManager.h"
+#include "Async/MappedFileHandle.h"
+#include <atomic>
+
+FArchive& operator<<(FArchive& Ar, FHexMapHeader& Header)
+{
+    Ar << Header.Magic << Header.Version;
+    Ar << Header.ChunkCountX << Header.ChunkCountZ;
+    Ar << Header.ChunkSizeX << Header.ChunkSizeZ;
+    Ar << Header.Compression;
+
+    if (Header.Version >= 2)
+    {
+        int32 NumColors = Header.Palette.Num();
+        Ar << NumColors;
+        if (Ar.IsLoading())
+        {
+            if (NumColors < 0 || NumColors > FHexCellPalette::MaxColors)
+            {
+                Ar.SetError();
+                return Ar;
+            }
+            Header.Palette.SetNum(NumColors);
+        }
+        for (FLinearColor& Color : Header.Palette)
+        {
+            Ar << Color;
+        }
+    }
+    return Ar;
+}
+
+FArchive& operator<<(FArchive& Ar, FHexMapBlockEntry& Entry)
+{
+    Ar << Entry.Offset << Entry.StoredSize;
+    return Ar;
+}
+
+namespace
+{
+    // Store index of local cell i of a chunk.
+    int32 GetBlockCell(const FHexCellStore& Store, int32 ChunkX, int32 ChunkZ, int32 i)
+    {
+        return Store.GetIndex(
+            ChunkX * HexMetrics::ChunkSizeX + i % HexMetrics::ChunkSizeX,
+            ChunkZ * HexMetrics::ChunkSizeZ + i / HexMetrics::ChunkSizeX);
+    }
+
+    // Writes cell Cell of Store as local cell i of the block at Out.
+    void EncodeCell(const FHexCellStore& Store, int32 Cell, int32 i, uint8* Out)
+    {
+        constexpr int32 N = HexMapFile::CellsPerBlock;
+        Out[i] = static_cast<uint8>(static_cast<int8>(Store.GetElevation(Cell)));
+        Out[N + i] = Store.GetColorIndex(Cell);
+        Out[N * 2 + i] = Store.GetRoadBits(Cell);
+    }
+
+    void EncodeBlock(const FHexCellStore& Store, int32 ChunkX, int32 ChunkZ, uint8* Out)
+    {
+        for (int32 i = 0; i < HexMapFile::CellsPerBlock; i++)
+        {
+            EncodeCell(Store, GetBlockCell(Store, ChunkX, ChunkZ, i), i, Out);
+        }
+    }
+
+    void DecodeBlock(const uint8* In, int32 ChunkX, int32 ChunkZ, FHexCellStore& Store)
+    {
+        constexpr int32 N = HexMapFile::CellsPerBlock;
+        for (int32 i = 0; i < N; i++)
+        {
+            const int32 Cell = GetBlockCell(Store, ChunkX, ChunkZ, i);
+            Store.SetElevation(Cell, static_cast<int8>(In[i]));
+            Store.SetColorIndex(Cell, In[N + i]);
+            Store.SetRoadBits(Cell, In[N * 2 + i]);
+        }
+    }
+
+    // Version 1 blocks carry colours, matched against the store's palette.
+    void DecodeBlockV1(const uint8* In, int32 ChunkX, int32 ChunkZ, FHexCellStore& Store)
+    {
+        constexpr int32 N = HexMapFile::CellsPerBlock;
+        const FHexCellPalette& Palette = Store.GetPalette();
+        for (int32 i = 0; i < N; i++)
+        {
+            const int32 Cell = GetBlockCell(Store, ChunkX, ChunkZ, i);
+            Store.SetElevation(Cell, static_cast<int8>(In[i]));
+            Store.SetColorIndex(Cell, Palette.FindClosest(FColor(In[N + i * 4 + 0], In[N + i * 4 + 1], In[N + i * 4 + 2], In[N + i * 4 + 3])));
+            Store.SetRoadBits(Cell, In[N * 5 + i]);
+        }
+    }
+}
+
+FName HexMapFile::GetFormatName(EHexMapCompression Compression)
+{
+    switch (Compression)
+    {
+    case EHexMapCompression::LZ4:   return NAME_LZ4;
+    case EHexMapCompression::Oodle: return NAME_Oodle;
+    default:                        return NAME_None;
+    }
+}
+
+bool HexMapFile::Save(const FString& Path, const FHexCellStore& Store, int32 ChunkCountX, int32 ChunkCountZ, EHexMapCompression Compression)
+{
+    if (Store.GetWidth() != ChunkCountX * HexMetrics::ChunkSizeX || Store.GetHeight() != ChunkCountZ * HexMetrics::ChunkSizeZ)
+    {
+        UE_LOG(LogTemp, Error, TEXT("SaveMap: cell store (%d x %d) does not match %d x %d chunks"),
+            Store.GetWidth(), Store.GetHeight(), ChunkCountX, ChunkCountZ);
+        return false;
+    }
+
+    FHexMapHeader Header;
+    Header.ChunkCountX = ChunkCountX;
+    Header.ChunkCountZ = ChunkCountZ;
+    Header.Compression = static_cast<uint8>(Compression);
+    const FHexCellPalette& Palette = Store.GetPalette();
+    Header.Palette.SetNum(Palette.Num());
+    for (int32 i = 0; i < Palette.Num(); i++)
+    {
+        Header.Palette[i] = Palette.GetColor(static_cast<uint8>(i));
+    }
+    const int32 NumBlocks = Header.NumBlocks();
+    const FName FormatName = GetFormatName(Compression);
+
+    // Blocks are encoded and compressed in parallel, then written in order.
+    TArray<TArray<uint8>> Payloads;
+    Payloads.SetNum(NumBlocks);
+    ParallelFor(NumBlocks, [&](int32 Block)
+    {
+        uint8 Raw[RawBlockSize];
+        EncodeBlock(Store, Block % ChunkCountX, Block / ChunkCountX, Raw);
+
+        TArray<uint8>& Payload = Payloads[Block];
+        if (!FormatName.IsNone())
+        {
+            int32 CompressedSize = FCompression::GetMaximumCompressedSize(FormatName, RawBlockSize);
+            Payload.SetNumUninitialized(CompressedSize);
+            if (FCompression::CompressMemory(FormatName, Payload.GetData(), CompressedSize, Raw, RawBlockSize) &&
+                CompressedSize < RawBlockSize)
+            {
+                Payload.SetNum(CompressedSize, EAllowShrinking::No);
+                return;
+            }
+        }
+        Payload.SetNumUninitialized(RawBlockSize);
+        FMemory::Memcpy(Payload.GetData(), Raw, RawBlockSize);
+    });
+
+    TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*Path));
+    if (!Writer)
+    {
+        UE_LOG(LogTemp, Error, TEXT("SaveMap: cannot open %s for writing"), *Path);
+        return false;
+    }
+
+    *Writer << Header;
+
+    TArray<FHexMapBlockEntry> Entries;
+    Entries.SetNum(NumBlocks);
+    uint64 Offset = Writer->Tell() + NumBlocks * (sizeof(uint64) + sizeof(uint32));
+    for (int32 Block = 0; Block < NumBlocks; Block++)
+    {
+        Entries[Block].Offset = Offset;
+        Entries[Block].StoredSize = Payloads[Block].Num();
+        Offset += Payloads[Block].Num();
+        *Writer << Entries[Block];
+    }
+    for (TArray<uint8>& Payload : Payloads)
+    {
+        Writer->Serialize(Payload.GetData(), Payload.Num());
+    }
+
+    const bool bSuccess = Writer->Close() && !Writer->IsError();
+    UE_LOG(LogTemp, Log, TEXT("SaveMap: wrote %d cells in %d blocks to %s (%lld bytes, %s)"),
+        Store.Num(), NumBlocks, *Path, Offset, FormatName.IsNone() ? TEXT("uncompressed") : *FormatName.ToString());
+    return bSuccess;
+}
+
+bool FHexMapReader::Open(const FString& Path)
+{
+    Archive.Reset(IFileManager::Get().CreateFileReader(*Path));
+    if (!Archive)
+    {
+        UE_LOG(LogTemp, Error, TEXT("LoadMap: cannot open %s"), *Path);
+        return false;
+    }
+
+    *Archive << Header;
+    if (Archive->IsError() || Header.Magic != HexMapFile::Magic)
+    {
+        UE_LOG(LogTemp, Error, TEXT("LoadMap: %s is not a hex map"), *Path);
+        return false;
+    }
+    if (Header.Version < HexMapFile::MinVersion || Header.Version > HexMapFile::Version)
+    {
+        UE_LOG(LogTemp, Error, TEXT("LoadMap: %s has version %u, expected %u to %u"), *Path, Header.Version, HexMapFile::MinVersion, HexMapFile::Version);
+        return false;
+    }
+    if (Header.ChunkSizeX != HexMetrics::ChunkSizeX || Header.ChunkSizeZ != HexMetrics::ChunkSizeZ ||
+        Header.ChunkCountX <= 0 || Header.ChunkCountZ <= 0 ||
+        Header.Compression > static_cast<uint8>(EHexMapCompression::Oodle))
+    {
+        UE_LOG(LogTemp, Error, TEXT("LoadMap: %s has an unsupported layout"), *Path);
+        return false;
+    }
+
+    const int64 FileSize = Archive->TotalSize();
+    const int32 RawBlockSize = HexMapFile::GetRawBlockSize(Header.Version);
+    Blocks.SetNum(Header.NumBlocks());
+    uint64 NextOffset = Archive->Tell() + Blocks.Num() * (sizeof(uint64) + sizeof(uint32));
+    for (FHexMapBlockEntry& Entry : Blocks)
+    {
+        *Archive << Entry;
+        if (Entry.Offset != NextOffset || Entry.StoredSize > static_cast<uint32>(RawBlockSize))
+        {
+            UE_LOG(LogTemp, Error, TEXT("LoadMap: %s has a corrupt block table"), *Path);
+            return false;
+        }
+        NextOffset += Entry.StoredSize;
+    }
+    if (Archive->IsError() || NextOffset > static_cast<uint64>(FileSize))
+    {
+        UE_LOG(LogTemp, Error, TEXT("LoadMap: %s is truncated"), *Path);
+        return false;
+    }
+    return true;
+}
+
+bool FHexMapReader::ReadBlocks(int32 FirstBlock, int32 Count, FHexCellStore& Store)
+{
+    if (!Archive || Count <= 0 || FirstBlock < 0 || FirstBlock + Count > Blocks.Num())
+    {
+        return false;
+    }
+
+    // Payloads are stored back to back, so the whole run is a single read.
+    const uint64 Begin = Blocks[FirstBlock].Offset;
+    const FHexMapBlockEntry& Last = Blocks[FirstBlock + Count - 1];
+    ReadBuffer.SetNumUninitialized(Last.Offset + Last.StoredSize - Begin, EAllowShrinking::No);
+    Archive->Seek(Begin);
+    Archive->Serialize(ReadBuffer.GetData(), ReadBuffer.Num());
+    if (Archive->IsError())
+    {
+        return false;
+    }
+
+    const FName FormatName = HexMapFile::GetFormatName(static_cast<EHexMapCompression>(Header.Compression));
+    const int32 RawBlockSize = HexMapFile::GetRawBlockSize(Header.Version);
+    std::atomic<bool> bCorrupt(false);
+    ParallelFor(Count, [&](int32 i)
+    {
+        const int32 Block = FirstBlock + i;
+        const FHexMapBlockEntry& Entry = Blocks[Block];
+        const uint8* Payload = ReadBuffer.GetData() + (Entry.Offset - Begin);
+
+        uint8 Raw[HexMapFile::RawBlockSizeV1];
+        if (Entry.StoredSize != static_cast<uint32>(RawBlockSize))
+        {
+            if (FormatName.IsNone() ||
+                !FCompression::UncompressMemory(FormatName, Raw, RawBlockSize, Payload, Entry.StoredSize))
+            {
+                bCorrupt.store(true, std::memory_order_relaxed);
+                return;
+            }
+            Payload = Raw;
+        }
+        if (Header.Version == 1)
+        {
+            DecodeBlockV1(Payload, Block % Header.ChunkCountX, Block / Header.ChunkCountX, Store);
+        }
+        else
+        {
+            DecodeBlock(Payload, Block % Header.ChunkCountX, Block / Header.ChunkCountX, Store);
+        }
+    });
+
+    return !bCorrupt.load(std::memory_order_relaxed);
+}
+
+FHexMapMapping::FHexMapMapping() = default;
+FHexMapMapping::~FHexMapMapping() = default;
+
+bool FHexMapMapping::Open(const FString& Path)
+{
+    // The table is validated like any other map; records must all be stored raw.
+    int64 FirstRecord = 0;
+    {
+        FHexMapReader Reader;
+        if (!Reader.Open(Path))
+        {
+            return false;
+        }
+        Header = Reader.GetHeader();
+        if (Header.Version != HexMapFile::Version)
+        {
+            UE_LOG(LogTemp, Error, TEXT("OpenMappedMap: %s has version %u; load it and save it again to map it"), *Path, Header.Version);
+            return false;
+        }
+        if (Header.Compression != static_cast<uint8>(EHexMapCompression::None))
+        {
+            UE_LOG(LogTemp, Error, TEXT("OpenMappedMap: %s is compressed; save it with EHexMapCompression::None"), *Path);
+            return false;
+        }
+        for (int32 Block = 0; Block < Reader.NumBlocks(); Block++)
+        {
+            if (Reader.GetBlock(Block).StoredSize != HexMapFile::RawBlockSize)
+            {
+                UE_LOG(LogTemp, Error, TEXT("OpenMappedMap: %s has a block of the wrong size"), *Path);
+                return false;
+            }
+        }
+        FirstRecord = Reader.GetBlock(0).Offset;
+    }
+
+    IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+    FOpenMappedResult Result = PlatformFile.OpenMappedEx(*Path, IPlatformFile::EOpenReadFlags::AllowWrite);
+    if (Result.HasError())
+    {
+        UE_LOG(LogTemp, Error, TEXT("OpenMappedMap: cannot map %s"), *Path);
+        return false;
+    }
+    Handle = Result.StealValue();
+
+    const int64 RecordBytes = static_cast<int64>(NumBlocks()) * HexMapFile::RawBlockSize;
+    Region.Reset(Handle->MapRegion(FirstRecord, RecordBytes, EMappedFileFlags::EFileWritable));
+    if (!Region)
+    {
+        UE_LOG(LogTemp, Error, TEXT("OpenMappedMap: cannot map the records of %s"), *Path);
+        Handle.Reset();
+        return false;
+    }
+    Records = const_cast<uint8*>(Region->GetMappedPtr());
+    MappedPath = Path;
+    return true;
+}
+
+void FHexMapMapping::ReadBlock(int32 Block, FHexCellStore& Store) const
+{
+    DecodeBlock(Records + static_cast<int64>(Block) * HexMapFile::RawBlockSize,
+        Block % Header.ChunkCountX, Block / Header.ChunkCountX, Store);
+}
+
+void FHexMapMapping::WriteCell(const FHexCellStore& Store, int32 CellIndex)
+{
+    const int32 X = Store.GetOffsetX(CellIndex);
+    const int32 Z = Store.GetOffsetZ(CellIndex);
+    const int32 Block = X / HexMetrics::ChunkSizeX + (Z / HexMetrics::ChunkSizeZ) * Header.ChunkCountX;
+    const int32 Local = X % HexMetrics::ChunkSizeX + (Z % HexMetrics::ChunkSizeZ) * HexMetrics::ChunkSizeX;
+    EncodeCell(Store, CellIndex, Local, Records + static_cast<int64>(Block) * HexMapFile::RawBlockSize);
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HexMetrics.h"
+#include "HexMapFile.generated.h"
+
+struct FHexCellStore;
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+UENUM(BlueprintType)
+enum class EHexMapCompression : uint8
+{
+    None,
+    LZ4,
+    Oodle
+};
+
+// Saved map layout, version 2:
+//
+//   FHexMapHeader, ending with the palette: an int32 count, then that many
+//     FLinearColor entries
+//   FHexMapBlockEntry, one per chunk in chunk index order
+//   block payloads, in the same order
+//
+// A block holds the cells of one chunk in local offset order, as separate runs
+// of elevations (int8), palette colour indices (uint8) and road bits (uint8).
+// Each block is compressed on its own, so any block can be decoded without the
+// rest; one whose stored size equals the raw block size is kept uncompressed.
+//
+// Version 1 stored sRGB R, G, B, A per cell instead of a palette index, and no
+// palette. Such maps still load, each colour becoming the closest entry of the
+// grid palette.
+namespace HexMapFile
+{
+    constexpr uint32 Magic = 0x4D584548; // "HEXM"
+    constexpr uint32 Version = 2;
+    constexpr uint32 MinVersion = 1;
+
+    constexpr int32 CellsPerBlock = HexMetrics::ChunkSizeX * HexMetrics::ChunkSizeZ;
+    constexpr int32 RawBlockSize = CellsPerBlock * (sizeof(int8) + sizeof(uint8) + sizeof(uint8));
+    constexpr int32 RawBlockSizeV1 = CellsPerBlock * (sizeof(int8) + 4 * sizeof(uint8) + sizeof(uint8));
+
+    constexpr int32 GetRawBlockSize(uint32 FileVersion) { return FileVersion == 1 ? RawBlockSizeV1 : RawBlockSize; }
+
+    FName GetFormatName(EHexMapCompression Compression);
+
+    // Writes every cell of Store, which must span ChunkCountX x ChunkCountZ chunks.
+    bool Save(const FString& Path, const FHexCellStore& Store, int32 ChunkCountX, int32 ChunkCountZ, EHexMapCompression Compression);
+}
+
+struct FHexMapHeader
+{
+    uint32 Magic = HexMapFile::Magic;
+    uint32 Version = HexMapFile::Version;
+    int32 ChunkCountX = 0;
+    int32 ChunkCountZ = 0;
+    int32 ChunkSizeX = HexMetrics::ChunkSizeX;
+    int32 ChunkSizeZ = HexMetrics::ChunkSizeZ;
+    uint8 Compression = 0;
+
+    // Colours the cell indices refer to; empty for version 1.
+    TArray<FLinearColor> Palette;
+
+    int32 NumBlocks() const { return ChunkCountX * ChunkCountZ; }
+
+    friend FArchive& operator<<(FArchive& Ar, FHexMapHeader& Header);
+};
+
+struct FHexMapBlockEntry
+{
+    uint64 Offset = 0;
+    uint32 StoredSize = 0;
+
+    friend FArchive& operator<<(FArchive& Ar, FHexMapBlockEntry& Entry);
+};
+
+// Reads a saved map a run of blocks at a time. Each run is one contiguous read;
+// the blocks in it are then decoded in parallel straight into a cell store.
+class CIVILIZATION_API FHexMapReader
+{
+public:
+    // Reads and validates the header and block table.
+    bool Open(const FString& Path);
+
+    const FHexMapHeader& GetHeader() const { return Header; }
+    int32 NumBlocks() const { return Blocks.Num(); }
+    const FHexMapBlockEntry& GetBlock(int32 Block) const { return Blocks[Block]; }
+
+    // Decodes blocks [FirstBlock, FirstBlock + Count) into Store, which must span
+    // the map's chunks. Returns false on a read error or a corrupt block.
+    bool ReadBlocks(int32 FirstBlock, int32 Count, FHexCellStore& Store);
+
+private:
+    TUniquePtr<FArchive> Archive;
+    FHexMapHeader Header;
+    TArray<FHexMapBlockEntry> Blocks;
+    TArray<uint8> ReadBuffer;
+};
+
+// A map file saved without compression, mapped writable. Its blocks are then
+// fixed-size records at known offsets, so a chunk can be read without touching
+// the rest of the file and a single cell can be written back in place. The OS
+// pages the records in and out; only the ones touched stay resident.
+class CIVILIZATION_API FHexMapMapping
+{
+public:
+    FHexMapMapping();
+    ~FHexMapMapping();
+
+    bool Open(const FString& Path);
+
+    const FHexMapHeader& GetHeader() const { return Header; }
+    int32 NumBlocks() const { return Header.NumBlocks(); }
+
+    // The file that is mapped, as passed to Open.
+    const FString& GetPath() const { return MappedPath; }
+
+    // Decodes one chunk record into Store, which must span the map's chunks.
+    void ReadBlock(int32 Block, FHexCellStore& Store) const;
+
+    // Writes the current values of one cell of Store to its record.
+    void WriteCell(const FHexCellStore& Store, int32 CellIndex);
+
+private:
+    TUniquePtr<IMappedFileHandle> Handle;
+    TUniquePtr<IMappedFileRegion> Region;
+    uint8* Records = nullptr;
+    FHexMapHeader Header;
+    FString MappedPath;
+};
@@ -0,0 +1,288 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HexDirection.h"
+
+// Axial hex coordinates: the cube X and Z of FHexCoordinates, with Y = -X - Z
+// implied. A plain literal type, so all of the algebra below is constexpr and
+// nothing is logged or reflected.
+struct FHexAxial
+{
+    int32 X = 0;
+    int32 Z = 0;
+
+    constexpr FHexAxial() = default;
+    constexpr FHexAxial(int32 InX, int32 InZ) : X(InX), Z(InZ) {}
+
+    constexpr int32 Y() const { return -X - Z; }
+
+    constexpr FHexAxial operator+(const FHexAxial& Other) const { return FHexAxial(X + Other.X, Z + Other.Z); }
+    constexpr FHexAxial operator-(const FHexAxial& Other) const { return FHexAxial(X - Other.X, Z - Other.Z); }
+    constexpr FHexAxial operator*(int32 Scale) const { return FHexAxial(X * Scale, Z * Scale); }
+    constexpr FHexAxial& operator+=(const FHexAxial& Other) { X += Other.X; Z += Other.Z; return *this; }
+    constexpr bool operator==(const FHexAxial& Other) const { return X == Other.X && Z == Other.Z; }
+    constexpr bool operator!=(const FHexAxial& Other) const { return !(*this == Other); }
+
+    // Offset coordinates as used by the cell store: odd rows are shifted east.
+    constexpr int32 GetOffsetX() const { return X + ((Z - (Z & 1)) / 2); }
+    constexpr int32 GetOffsetZ() const { return Z; }
+    static constexpr FHexAxial FromOffset(int32 OffsetX, int32 OffsetZ) { return FHexAxial(OffsetX - (OffsetZ - (OffsetZ & 1)) / 2, OffsetZ); }
+
+    friend uint32 GetTypeHash(const FHexAxial& Value) { return HashCombineFast(::GetTypeHash(Value.X), ::GetTypeHash(Value.Z)); }
+};
+
+namespace HexMath
+{
+    // Steps to the neighbour in each EHexDirection.
+    inline constexpr FHexAxial Directions[6] = {
+        FHexAxial(0, 1),   // NE
+        FHexAxial(1, 0),   // E
+        FHexAxial(1, -1),  // SE
+        FHexAxial(0, -1),  // SW
+        FHexAxial(-1, 0),  // W
+        FHexAxial(-1, 1)   // NW
+    };
+
+    constexpr int32 Abs(int32 Value) { return Value < 0 ? -Value : Value; }
+
+    constexpr FHexAxial Direction(EHexDirection Dir) { return Directions[static_cast<int32>(Dir)]; }
+    constexpr FHexAxial Neighbor(const FHexAxial& Cell, EHexDirection Dir) { return Cell + Direction(Dir); }
+
+    constexpr int32 Length(const FHexAxial& Cell) { return (Abs(Cell.X) + Abs(Cell.Y()) + Abs(Cell.Z)) / 2; }
+    constexpr int32 Distance(const FHexAxial& A, const FHexAxial& B) { return Length(A - B); }
+
+    // Number of cells within Radius of a cell, the cell included.
+    constexpr int32 RangeCount(int32 Radius) { return Radius < 0 ? 0 : 3 * Radius * (Radius + 1) + 1; }
+
+    // First and last X offset, relative to the centre, of row DZ of a range.
+    constexpr int32 RangeRowBegin(int32 DZ, int32 Radius) { return -Radius > -DZ - Radius ? -Radius : -DZ - Radius; }
+    constexpr int32 RangeRowEnd(int32 DZ, int32 Radius) { return Radius < -DZ + Radius ? Radius : -DZ + Radius; }
+
+    // 60 degree rotations about the origin or a centre, clockwise (NE -> E) and
+    // counter-clockwise (NE -> NW).
+    constexpr FHexAxial RotateRight(const FHexAxial& Cell) { return FHexAxial(-Cell.Y(), -Cell.X); }
+    constexpr FHexAxial RotateLeft(const FHexAxial& Cell) { return FHexAxial(-Cell.Z, -Cell.Y()); }
+
+    constexpr FHexAxial Rotate(const FHexAxial& Cell, int32 Steps)
+    {
+        FHexAxial Result = Cell;
+        for (int32 i = ((Steps % 6) + 6) % 6; i > 0; i--)
+        {
+            Result = RotateRight(Result);
+        }
+        return Result;
+    }
+
+    constexpr FHexAxial Rotate(const FHexAxial& Cell, const FHexAxial& Center, int32 Steps) { return Center + Rotate(Cell - Center, Steps); }
+
+    // Reflections across the axis through the origin (or a centre) along which
+    // the named cube coordinate stays constant.
+    constexpr FHexAxial ReflectX(const FHexAxial& Cell) { return FHexAxial(Cell.X, Cell.Y()); }
+    constexpr FHexAxial ReflectY(const FHexAxial& Cell) { return FHexAxial(Cell.Z, Cell.X); }
+    constexpr FHexAxial ReflectZ(const FHexAxial& Cell) { return FHexAxial(Cell.Y(), Cell.Z); }
+    constexpr FHexAxial ReflectX(const FHexAxial& Cell, const FHexAxial& Center) { return Center + ReflectX(Cell - Center); }
+    constexpr FHexAxial ReflectY(const FHexAxial& Cell, const FHexAxial& Center) { return Center + ReflectY(Cell - Center); }
+    constexpr FHexAxial ReflectZ(const FHexAxial& Cell, const FHexAxial& Center) { return Center + ReflectZ(Cell - Center); }
+
+    // Nearest cell to fractional axial coordinates.
+    FORCEINLINE FHexAxial Round(float X, float Z)
+    {
+        const float Y = -X - Z;
+        int32 RoundX = FMath::RoundToInt(X);
+        int32 RoundZ = FMath::RoundToInt(Z);
+        const int32 RoundY = FMath::RoundToInt(Y);
+
+        const float DeltaX = FMath::Abs(X - RoundX);
+        const float DeltaY = FMath::Abs(Y - RoundY);
+        const float DeltaZ = FMath::Abs(Z - RoundZ);
+        if (DeltaX > DeltaY && DeltaX > DeltaZ)
+        {
+            RoundX = -RoundY - RoundZ;
+        }
+        else if (DeltaZ > DeltaY)
+        {
+            RoundZ = -RoundX - RoundY;
+        }
+        return FHexAxial(RoundX, RoundZ);
+    }
+
+    // Range-for sentinel shared by the ranges below.
+    struct FEnd {};
+
+    // Cells at exactly Radius from Center, starting west of it and walking
+    // NE, E, SE, SW, W and NW. Radius 0 yields Center alone.
+    class FRing
+    {
+    public:
+        class FIterator
+        {
+        public:
+            constexpr FIterator(const FHexAxial& Center, int32 InRadius)
+                : Cell(Center + Directions[4] * InRadius), Radius(InRadius), Side(0), Step(0) {}
+
+            constexpr const FHexAxial& operator*() const { return Cell; }
+            constexpr bool operator!=(FEnd) const { return Side < 6; }
+            constexpr FIterator& operator++()
+            {
+                if (Radius == 0)
+                {
+                    Side = 6;
+                    return *this;
+                }
+                Cell += Directions[Side];
+                if (++Step == Radius)
+                {
+                    Step = 0;
+                    Side++;
+                }
+                return *this;
+            }
+
+        private:
+            FHexAxial Cell;
+            int32 Radius;
+            int32 Side;
+            int32 Step;
+        };
+
+        constexpr FRing(const FHexAxial& InCenter, int32 InRadius) : Center(InCenter), Radius(InRadius) {}
+        constexpr FIterator begin() const { return FIterator(Center, Radius); }
+        constexpr FEnd end() const { return FEnd(); }
+
+    private:
+        FHexAxial Center;
+        int32 Radius;
+    };
+
+    // Center, then ring 1, ring 2, ... up to Radius.
+    class FSpiral
+    {
+    public:
+        class FIterator
+        {
+        public:
+            constexpr FIterator(const FHexAxial& InCenter, int32 InRadius)
+                : Center(InCenter), MaxRadius(InRadius), Radius(0), Ring(InCenter, 0) {}
+
+            constexpr const FHexAxial& operator*() const { return *Ring; }
+            constexpr bool operator!=(FEnd) const { return Radius <= MaxRadius; }
+            constexpr FIterator& operator++()
+            {
+                ++Ring;
+                if (!(Ring != FEnd()))
+                {
+                    Radius++;
+                    Ring = FRing::FIterator(Center, Radius);
+                }
+                return *this;
+            }
+
+        private:
+            FHexAxial Center;
+            int32 MaxRadius;
+            int32 Radius;
+            FRing::FIterator Ring;
+        };
+
+        constexpr FSpiral(const FHexAxial& InCenter, int32 InRadius) : Center(InCenter), Radius(InRadius) {}
+        constexpr FIterator begin() const { return FIterator(Center, Radius); }
+        constexpr FEnd end() const { return FEnd(); }
+
+    private:
+        FHexAxial Center;
+        int32 Radius;
+    };
+
+    // Every cell within Radius of Center, row by row (increasing Z, then X), so
+    // cell store indices are visited in increasing order.
+    class FRange
+    {
+    public:
+        class FIterator
+        {
+        public:
+            constexpr FIterator(const FHexAxial& InCenter, int32 InRadius)
+                : Center(InCenter), Radius(InRadius), DZ(-InRadius), DX(RangeRowBegin(-InRadius, InRadius)) {}
+
+            constexpr FHexAxial operator*() const { return FHexAxial(Center.X + DX, Center.Z + DZ); }
+            constexpr bool operator!=(FEnd) const { return Radius >= 0 && DZ <= Radius; }
+            constexpr FIterator& operator++()
+            {
+                if (++DX > RangeRowEnd(DZ, Radius))
+                {
+                    DZ++;
+                    DX = RangeRowBegin(DZ, Radius);
+                }
+                return *this;
+            }
+
+        private:
+            FHexAxial Center;
+            int32 Radius;
+            int32 DZ;
+            int32 DX;
+        };
+
+        constexpr FRange(const FHexAxial& InCenter, int32 InRadius) : Center(InCenter), Radius(InRadius) {}
+        constexpr FIterator begin() const { return FIterator(Center, Radius); }
+        constexpr FEnd end() const { return FEnd(); }
+
+    private:
+        FHexAxial Center;
+        int32 Radius;
+    };
+
+    // Cells on the straight line from A to B, both included, one per step of distance.
+    class FLine
+    {
+    public:
+        class FIterator
+        {
+        public:
+            FIterator(const FHexAxial& InA, const FHexAxial& InB)
+                : A(InA), B(InB), Count(Distance(InA, InB)), Step(0), Cell(InA) {}
+
+            const FHexAxial& operator*() const { return Cell; }
+            bool operator!=(FEnd) const { return Step <= Count; }
+            FIterator& operator++()
+            {
+                if (++Step <= Count)
+                {
+                    // The small nudge keeps points on cell edges from rounding both ways.
+                    const float T = static_cast<float>(Step) / Count;
+                    Cell = Round(
+                        FMath::Lerp(A.X + 1.e-6f, B.X + 1.e-6f, T),
+                        FMath::Lerp(A.Z + 2.e-6f, B.Z + 2.e-6f, T));
+                }
+                return *this;
+            }
+
+        private:
+            FHexAxial A;
+            FHexAxial B;
+            int32 Count;
+            int32 Step;
+            FHexAxial Cell;
+        };
+
+        FLine(const FHexAxial& InA, const FHexAxial& InB) : A(InA), B(InB) {}
+        FIterator begin() const { return FIterator(A, B); }
+        FEnd end() const { return FEnd(); }
+
+    private:
+        FHexAxial A;
+        FHexAxial B;
+    };
+
+    constexpr FRing Ring(const FHexAxial& Center, int32 Radius) { return FRing(Center, Radius); }
+    constexpr FSpiral Spiral(const FHexAxial& Center, int32 Radius) { return FSpiral(Center, Radius); }
+    constexpr FRange Range(const FHexAxial& Center, int32 Radius) { return FRange(Center, Radius); }
+    inline FLine Line(const FHexAxial& A, const FHexAxial& B) { return FLine(A, B); }
+
+    static_assert(Distance(FHexAxial(0, 0), FHexAxial(3, -1)) == 3, "HexMath::Distance");
+    static_assert(RotateRight(Directions[0]) == Directions[1], "HexMath::RotateRight");
+    static_assert(RotateLeft(Directions[0]) == Directions[5], "HexMath::RotateLeft");
+    static_assert(Rotate(Directions[2], -2) == Directions[0], "HexMath::Rotate");
+    static_assert(ReflectZ(ReflectZ(FHexAxial(2, -5))) == FHexAxial(2, -5), "HexMath::ReflectZ");
+    static_assert(FHexAxial::FromOffset(FHexAxial(4, 3).GetOffsetX(), 3) == FHexAxial(4, 3), "FHexAxial offset round trip");
+}
@@ -0,0 +1,60 @@
+#include "HexMetrics.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FHexNoiseBatchTest, "Civilization.HexMetrics.SampleNoiseBatch",
+    EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+// The batched noise path must agree with the scalar reference, for batches
+// that fill whole four-point steps and for ones that end in a padded step.
+bool FHexNoiseBatchTest::RunTest(const FString& Parameters)
+{
+    // The test brings its own noise, and puts the grid's back afterwards.
+    TArray<FColor> SavedData = MoveTemp(HexMetrics::NoiseData);
+    TArray<FVector4f> SavedField = MoveTemp(HexMetrics::NoiseField);
+    const int32 SavedWidth = HexMetrics::NoiseWidth;
+    const int32 SavedHeight = HexMetrics::NoiseHeight;
+
+    FRandomStream Random(0x4E015E);
+    HexMetrics::NoiseWidth = 61;
+    HexMetrics::NoiseHeight = 37;
+    HexMetrics::NoiseData.SetNumUninitialized(HexMetrics::NoiseWidth * HexMetrics::NoiseHeight);
+    for (FColor& Color : HexMetrics::NoiseData)
+    {
+        Color = FColor(Random.RandRange(0, 255), Random.RandRange(0, 255), Random.RandRange(0, 255), Random.RandRange(0, 255));
+    }
+    HexMetrics::BuildNoiseField();
+
+    for (const int32 Count : { 1, 2, 3, 4, 5, 7, 8, 13, 1021, 1024 })
+    {
+        TArray<FVector> Positions;
+        Positions.SetNumUninitialized(Count);
+        for (FVector& Position : Positions)
+        {
+            Position = FVector(Random.FRandRange(-1000.0f, 1000.0f), Random.FRandRange(-1000.0f, 1000.0f), Random.FRandRange(-10.0f, 10.0f));
+        }
+
+        TArray<FVector4f> Samples;
+        Samples.SetNumUninitialized(Count);
+        HexMetrics::SampleNoiseBatch(Positions.GetData(), Samples.GetData(), Count);
+
+        int32 Mismatches = 0;
+        for (int32 i = 0; i < Count; i++)
+        {
+            if (!FVector4(Samples[i]).Equals(HexMetrics::SampleNoise(Positions[i]), 1.e-4f))
+            {
+                Mismatches++;
+            }
+        }
+        TestEqual(FString::Printf(TEXT("Batched samples differing from SampleNoise, batch of %d"), Count), Mismatches, 0);
+    }
+
+    HexMetrics::NoiseData = MoveTemp(SavedData);
+    HexMetrics::NoiseField = MoveTemp(SavedField);
+    HexMetrics::NoiseWidth = SavedWidth;
+    HexMetrics::NoiseHeight = SavedHeight;
+    return true;
+}
+
+#endif
@@ -0,0 +1,69 @@
+#include "HexPerturbCache.h"
+#include "HexMetrics.h"
+
+void FHexPerturbCache::Validate(uint32 Generation)
+{
+    if (Generation != CachedGeneration)
+    {
+        Offsets.Reset();
+        CachedGeneration = Generation;
+    }
+}
+
+void FHexPerturbCache::Reset()
+{
+    Offsets.Empty();
+}
+
+uint64 FHexPerturbCache::MakeKey(const FVector& Position)
+{
+    const uint32 KeyX = static_cast<uint32>(FMath::RoundToInt(Position.X * KeyPrecision));
+    const uint32 KeyY = static_cast<uint32>(FMath::RoundToInt(Position.Y * KeyPrecision));
+    return (static_cast<uint64>(KeyX) << 32) | KeyY;
+}
+
+FVector FHexPerturbCache::Perturb(const FVector& Position)
+{
+    FVector Result = Position;
+    Perturb(&Result, 1);
+    return Result;
+}
+
+void FHexPerturbCache::Perturb(FVector* Positions, int32 Count)
+{
+    // Scratch for the misses, kept per thread so batches never allocate once
+    // they have grown to the largest template.
+    static thread_local TArray<int32> Misses;
+    static thread_local TArray<FVector> Sampled;
+    Misses.SetNumUninitialized(Count, EAllowShrinking::No);
+    Sampled.SetNumUninitialized(Count, EAllowShrinking::No);
+
+    int32 NumMisses = 0;
+    for (int32 i = 0; i < Count; i++)
+    {
+        if (const FVector2D* Offset = Offsets.Find(MakeKey(Positions[i])))
+        {
+            Positions[i].X += Offset->X;
+            Positions[i].Y += Offset->Y;
+        }
+        else
+        {
+            Misses[NumMisses] = i;
+            Sampled[NumMisses] = Positions[i];
+            NumMisses++;
+        }
+    }
+
+    if (NumMisses == 0)
+    {
+        return;
+    }
+
+    HexMetrics::PerturbBatch(Sampled.GetData(), NumMisses);
+    for (int32 j = 0; j < NumMisses; j++)
+    {
+        FVector& Position = Positions[Misses[j]];
+        Offsets.Add(MakeKey(Position), FVector2D(Sampled[j].X - Position.X, Sampled[j].Y - Position.Y));
+        Position = Sampled[j];
+    }
+}
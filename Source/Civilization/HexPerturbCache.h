@@ -0,0 +1,33 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Perturbed offsets keyed by quantized XY position. Perturbation ignores
+// elevation, so one entry serves every vertex stacked above the same point and
+// stays valid across rebuilds until HexMetrics::NoiseGeneration changes.
+//
+// Not thread-safe: each chunk owns one cache and only its single in-flight
+// build touches it.
+class CIVILIZATION_API FHexPerturbCache
+{
+public:
+    // Positions closer than 1 / KeyPrecision share an entry.
+    static constexpr float KeyPrecision = 1024.0f;
+
+    // Drops every entry if the cache was filled with a different noise generation.
+    void Validate(uint32 Generation);
+    void Reset();
+
+    // Same result as HexMetrics::Perturb, sampling noise only on a miss.
+    FVector Perturb(const FVector& Position);
+    // Perturbs in place; all misses are sampled in one HexMetrics::PerturbBatch call.
+    void Perturb(FVector* Positions, int32 Count);
+
+    int32 Num() const { return Offsets.Num(); }
+
+private:
+    static uint64 MakeKey(const FVector& Position);
+
+    TMap<uint64, FVector2D> Offsets;
+    uint32 CachedGeneration = 0;
+};
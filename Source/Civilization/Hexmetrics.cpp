@@ -9,11 +9,16 @@ const float HexMetrics::ElevationStep = 1.0f;
 const float HexMetrics::HorizontalTerraceStepSize = 1.0f / TerraceSteps;
 const float HexMetrics::VerticalTerraceStepSize = 1.0f / (TerracesPerSlope + 1);
 const float HexMetrics::StreamBedElevationOffset = 0.f;//-1
+const float HexMetrics::RoadElevationOffset = 0.02f;
 
 float HexMetrics::CellPerturbStrength = 0.5f; // 1.5 is normal
 float HexMetrics::NoiseScale = 0.01f; // 0.01 normal
+uint32 HexMetrics::NoiseGeneration = 0;
 
-UTexture2D* HexMetrics::NoiseSource = nullptr;TArray<FColor> HexMetrics::NoiseData;TArray<FVector> HexMetrics::Corners = {
+UTexture2D* HexMetrics::NoiseSource = nullptr;TArray<FColor> HexMetrics::NoiseData;
+TArray<FVector4f> HexMetrics::NoiseField;
+int32 HexMetrics::NoiseWidth = 0;
+int32 HexMetrics::NoiseHeight = 0;TArray<FVector> HexMetrics::Corners = {
     FVector(0.0f, OuterRadius, 0.0f),           // NE
     FVector(InnerRadius, OuterRadius / 2, 0.0f), // E
     FVector(InnerRadius, -OuterRadius / 2, 0.0f), // SE
@@ -41,13 +46,13 @@ HexMetrics::EHexEdgeType HexMetrics::GetEdgeType(int32 Elevation1, int32 Elevati
 
 }FVector4 HexMetrics::SampleNoise(FVector Position)
 {
-    if (NoiseData.Num() == 0 || !NoiseSource)
+    if (NoiseData.Num() == 0 || NoiseData.Num() != NoiseWidth * NoiseHeight)
     {
         return FVector4(0.5f, 0.5f, 0.5f, 0.5f);
     }
 
-    int32 Width = NoiseSource->GetSizeX();
-    int32 Height = NoiseSource->GetSizeY();
+    int32 Width = NoiseWidth;
+    int32 Height = NoiseHeight;
 
     float U = (Position.X * NoiseScale) - FMath::FloorToFloat(Position.X * NoiseScale);
     float V = (Position.Y * NoiseScale) - FMath::FloorToFloat(Position.Y * NoiseScale);
@@ -83,6 +88,126 @@ HexMetrics::EHexEdgeType HexMetrics::GetEdgeType(int32 Elevation1, int32 Elevati
     return Position;
 }
 
+void HexMetrics::BuildNoiseField()
+{
+    NoiseField.SetNumUninitialized(NoiseData.Num());
+    for (int32 i = 0; i < NoiseData.Num(); i++)
+    {
+        const FColor& C = NoiseData[i];
+        NoiseField[i] = FVector4f((float)C.R / 255.0f, (float)C.G / 255.0f, (float)C.B / 255.0f, (float)C.A / 255.0f);
+    }
+}
+
+namespace
+{
+    // Samples the noise field at four points. Texel addresses and filter
+    // weights are worked out for all four points at once, one lane each, with
+    // the same addressing as HexMetrics::SampleNoise; then each point blends
+    // the four channels of its texels in one register.
+    void SampleNoise4(const FVector* Points, FVector4f* Out, const FVector4f* Field, int32 Width, int32 Height, float Scale)
+    {
+        const VectorRegister4Float Zero = VectorZeroFloat();
+        const VectorRegister4Float One = VectorOneFloat();
+        const VectorRegister4Float MaxX = VectorSetFloat1(static_cast<float>(Width - 1));
+        const VectorRegister4Float MaxY = VectorSetFloat1(static_cast<float>(Height - 1));
+
+        VectorRegister4Float U = MakeVectorRegisterFloat(static_cast<float>(Points[0].X * Scale), static_cast<float>(Points[1].X * Scale),
+            static_cast<float>(Points[2].X * Scale), static_cast<float>(Points[3].X * Scale));
+        VectorRegister4Float V = MakeVectorRegisterFloat(static_cast<float>(Points[0].Y * Scale), static_cast<float>(Points[1].Y * Scale),
+            static_cast<float>(Points[2].Y * Scale), static_cast<float>(Points[3].Y * Scale));
+        U = VectorMin(VectorMax(VectorSubtract(U, VectorFloor(U)), Zero), One);
+        V = VectorMin(VectorMax(VectorSubtract(V, VectorFloor(V)), Zero), One);
+
+        const VectorRegister4Float TexelX = VectorMultiply(U, MaxX);
+        const VectorRegister4Float TexelY = VectorMultiply(V, MaxY);
+        const VectorRegister4Float X0 = VectorFloor(TexelX);
+        const VectorRegister4Float Y0 = VectorFloor(TexelY);
+        const VectorRegister4Float X1 = VectorMin(VectorAdd(X0, One), MaxX);
+        const VectorRegister4Float Y1 = VectorMin(VectorAdd(Y0, One), MaxY);
+
+        // Texel indices are exact in float for any field up to 4096 x 4096.
+        const VectorRegister4Float RowStride = VectorSetFloat1(static_cast<float>(Width));
+        const VectorRegister4Float Row0 = VectorMultiply(Y0, RowStride);
+        const VectorRegister4Float Row1 = VectorMultiply(Y1, RowStride);
+        alignas(16) int32 I00[4];
+        alignas(16) int32 I10[4];
+        alignas(16) int32 I01[4];
+        alignas(16) int32 I11[4];
+        VectorIntStore(VectorFloatToInt(VectorAdd(Row0, X0)), I00);
+        VectorIntStore(VectorFloatToInt(VectorAdd(Row0, X1)), I10);
+        VectorIntStore(VectorFloatToInt(VectorAdd(Row1, X0)), I01);
+        VectorIntStore(VectorFloatToInt(VectorAdd(Row1, X1)), I11);
+
+        alignas(16) float FracX[4];
+        alignas(16) float FracY[4];
+        VectorStoreAligned(VectorSubtract(TexelX, X0), FracX);
+        VectorStoreAligned(VectorSubtract(TexelY, Y0), FracY);
+
+        for (int32 Lane = 0; Lane < 4; Lane++)
+        {
+            const VectorRegister4Float C00 = VectorLoad(&Field[I00[Lane]].X);
+            const VectorRegister4Float C10 = VectorLoad(&Field[I10[Lane]].X);
+            const VectorRegister4Float C01 = VectorLoad(&Field[I01[Lane]].X);
+            const VectorRegister4Float C11 = VectorLoad(&Field[I11[Lane]].X);
+            const VectorRegister4Float WeightX = VectorLoadFloat1(&FracX[Lane]);
+            const VectorRegister4Float WeightY = VectorLoadFloat1(&FracY[Lane]);
+
+            const VectorRegister4Float Bottom = VectorMultiplyAdd(VectorSubtract(C10, C00), WeightX, C00);
+            const VectorRegister4Float Top = VectorMultiplyAdd(VectorSubtract(C11, C01), WeightX, C01);
+            VectorStore(VectorMultiplyAdd(VectorSubtract(Top, Bottom), WeightY, Bottom), &Out[Lane].X);
+        }
+    }
+}
+
+void HexMetrics::SampleNoiseBatch(const FVector* Positions, FVector4f* OutSamples, int32 Count)
+{
+    if (NoiseField.Num() == 0 || NoiseField.Num() != NoiseWidth * NoiseHeight)
+    {
+        for (int32 i = 0; i < Count; i++)
+        {
+            OutSamples[i] = FVector4f(0.5f, 0.5f, 0.5f, 0.5f);
+        }
+        return;
+    }
+
+    const FVector4f* Field = NoiseField.GetData();
+    const int32 Whole = Count & ~3;
+    for (int32 i = 0; i < Whole; i += 4)
+    {
+        SampleNoise4(Positions + i, OutSamples + i, Field, NoiseWidth, NoiseHeight, NoiseScale);
+    }
+
+    // The last one to three points go through the same path, padded with
+    // copies of the last point.
+    if (Whole < Count)
+    {
+        FVector Tail[4];
+        FVector4f TailSamples[4];
+        for (int32 Lane = 0; Lane < 4; Lane++)
+        {
+            Tail[Lane] = Positions[FMath::Min(Whole + Lane, Count - 1)];
+        }
+        SampleNoise4(Tail, TailSamples, Field, NoiseWidth, NoiseHeight, NoiseScale);
+        for (int32 i = Whole; i < Count; i++)
+        {
+            OutSamples[i] = TailSamples[i - Whole];
+        }
+    }
+}
+
+void HexMetrics::PerturbBatch(FVector* Positions, int32 Count)
+{
+    TArray<FVector4f, TInlineAllocator<16>> Samples;
+    Samples.SetNumUninitialized(Count);
+    SampleNoiseBatch(Positions, Samples.GetData(), Count);
+
+    for (int32 i = 0; i < Count; i++)
+    {
+        Positions[i].X += (Samples[i].X * 2.0f - 1.0f) * CellPerturbStrength;
+        Positions[i].Y += (Samples[i].Y * 2.0f - 1.0f) * CellPerturbStrength;
+    }
+}
+
 FVector HexMetrics::TerraceLerp(FVector A, FVector B, int32 Step)
 {
     float H = Step * HorizontalTerraceStepSize;
@@ -6,6 +6,11 @@ class HexMetrics
 {
 public:
     static TArray<FColor> NoiseData;
+    // NoiseData converted to floats once, for the batched sampling path.
+    static TArray<FVector4f> NoiseField;
+    // Size of NoiseData, cached so worker threads never touch the NoiseSource texture.
+    static int32 NoiseWidth;
+    static int32 NoiseHeight;
 
     enum class EHexEdgeType
     {
@@ -53,6 +58,8 @@ public:
 
     static const float ElevationStep;
     static const float StreamBedElevationOffset;
+    // Height of road meshes above the terrain they follow.
+    static const float RoadElevationOffset;
 
     static const int32 TerracesPerSlope = 2;
     static const int32 TerraceSteps = TerracesPerSlope * 2 + 1;
@@ -65,9 +72,22 @@ public:
     static float CellPerturbStrength;
     static float NoiseScale;
 
+    // Bumped whenever NoiseData, NoiseScale or CellPerturbStrength change, so
+    // cached perturbations (FHexPerturbCache) know they are stale.
+    static uint32 NoiseGeneration;
+    static void InvalidateNoise() { NoiseGeneration++; }
+
+    // Scalar reference path, sampling NoiseData directly.
     static FVector4 SampleNoise(FVector Position);
     static FVector Perturb(FVector Position);
 
+    // Batched path over NoiseField. Texel addresses and weights are computed
+    // four points at a time, and each point filters all four channels in one
+    // vector register. Matches the scalar path to float precision.
+    static void BuildNoiseField();
+    static void SampleNoiseBatch(const FVector* Positions, FVector4f* OutSamples, int32 Count);
+    static void PerturbBatch(FVector* Positions, int32 Count);
+
     static EHexDirection Opposite(EHexDirection Direction)
     {
         int32 DirIndex = static_cast<int32>(Direction);